@@ -1,22 +1,73 @@
+#define _GNU_SOURCE // pthread_setaffinity_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <time.h>
 #include <math.h>
 #include <ctype.h>
-
-#define M 3 // Order: Max children = M, Max keys = M-1
-#define MAX_SPACES 50
-#define MAX_VEHICLES 150
+#include <stdarg.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <sched.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Tree order per key type: max children = ORDER, max keys = ORDER-1
+#ifndef V_ORDER
+#define V_ORDER 32
+#endif
+#ifndef S_ORDER
+#define S_ORDER 64
+#endif
+#define MAX_ORDER (V_ORDER > S_ORDER ? V_ORDER : S_ORDER)
+#define CACHE_LINE 64
+#define GOLD_LAST_SPACE 10       // Golden tier: spaces 1-10
+#define PREMIUM_LAST_SPACE 20    // Premium tier: spaces 11-20, general: 21+
+#define NUM_TIERS 3
+#define PARSE_MIN_CHUNK (1 << 20) // Smallest slice of an input file worth its own thread
+#define MAX_REPORTED_ERRORS 100
+#define SORT_RUN 16                 // Insertion-sorted run length before merging
+#define SORT_PARALLEL_MIN (1 << 15) // Smallest per-thread share worth a sort thread
+#define SORT_MAX_PARTS 64
+#define SNAPSHOT_FILE "parking.snap"
+#define SNAP_MAGIC "SVPSNAP"
+#define SNAP_VERSION 3 // 3: epoch-minute timestamps; version 2 files are converted on load
+#define CHECKSUM_SEED 0xcbf29ce484222325ULL
+#define JOURNAL_FILE "parking.journal"
+#define ARCHIVE_FILE "parking-archive.txt" // Dormant vehicles, same line format as the vehicle database
+#define STATS_FILE "parking-stats.json" // Written by the Engine Stats menu option
+#define JOURNAL_BATCH_BYTES (64 * 1024) // Flush early once this much is pending
+#define STORE_CHUNK 4096        // Vehicle records per slab chunk
+#define STORE_MAX_CHUNKS 65536
+#define MAX_LOTS 64
+#define LOT_QUEUE 64      // Pending jobs per lot worker
+#define LOT_PATH_MAX 512
+#define PLATE_LOCKS 64    // Striped per-plate gate locks per lot
+
+typedef int32_t EpochMin; // Minutes since the Unix epoch
+#define STAMP_NONE 0
 
 typedef struct Vehicle {
     char v_num[20];
     char owner[50];
-    char arr_date[11];
-    char arr_time[5];
-    char dep_date[11];
-    char dep_time[5];
+    EpochMin arrived;  // STAMP_NONE if unknown
+    EpochMin departed; // STAMP_NONE while parked or never departed
     int  membership;
     float total_hrs;
     int space_id;
@@ -24,6 +75,35 @@ typedef struct Vehicle {
     float revenue;
 } Vehicle;
 
+typedef unsigned int VHandle; // Stable index of a record in the vehicle store
+#define VH_NONE 0
+
+typedef uint64_t PlateKey; // Order-preserving code of a plate, see encodePlate
+#define PLATE_SYMBOLS 12   // Base-37 symbols that fit below the flag bit
+#define PLATE_INEXACT 1ULL // Other plates may share the code; ties compare the text
+
+// Slab of vehicle records; chunks never move, so handles and pointers stay valid.
+typedef struct VehicleStore {
+    Vehicle *chunks[STORE_MAX_CHUNKS];
+    unsigned int count; // Next handle to issue
+    VHandle *free_list; // Released handles, reused before new ones are issued
+    int nfree, free_cap;
+} VehicleStore;
+
+// Open-addressing index from plate to handle, kept beside the vehicle tree so gate
+// lookups take one probe. Linear probing; deletions shift later entries back.
+typedef struct PlateSlot {
+    PlateKey code;
+    uint32_t hash;
+    VHandle h; // VH_NONE marks an empty slot
+} PlateSlot;
+
+typedef struct PlateIndex {
+    PlateSlot *slots;
+    uint32_t mask, count;
+} PlateIndex;
+#define PINDEX_MIN_SLOTS 1024
+
 typedef struct ParkingSpace {
     int id;
     int status;
@@ -31,89 +111,879 @@ typedef struct ParkingSpace {
     float hrs;
 } ParkingSpace;
 
+typedef enum { OVERFLOW_NONE, OVERFLOW_DOWN } OverflowPolicy;
+
+// Free-space bitmap for one tier: bit set = space free. The summary has a bit per non-empty word.
+typedef struct SpaceTier {
+    int first, last;
+    int nwords;
+    unsigned long long *free_bits;
+    unsigned long long *summary;
+    int nfree;
+    VHandle *occupant; // Per space: the vehicle parked in it, or VH_NONE
+    int noccupied;
+} SpaceTier;
+
+typedef struct SpaceAllocator {
+    SpaceTier tiers[NUM_TIERS]; // Gold, premium, general
+    OverflowPolicy overflow;    // OVERFLOW_DOWN lets a full tier fall through to the ones below it
+} SpaceAllocator;
+
+enum { J_ENTRY = 1, J_EXIT = 2, J_ARCHIVE = 3, J_DROP_SPACE = 4 };
+
+// On-disk journal record header; the plate and owner bytes follow it.
+typedef struct JournalRecHdr {
+    uint32_t sum;       // Checksum of the rest of the record
+    uint16_t len;       // Whole record, header included
+    uint8_t type;
+    uint8_t plate_len;
+    uint64_t lsn;
+    int64_t ts;
+    int32_t space_id;
+    uint8_t owner_len;
+    uint8_t pad[3];
+} JournalRecHdr;
+
+// Append-only event log with group commit: a flusher thread writes and fsyncs
+// pending records at most `budget_ms` after the first of them was appended.
+typedef struct Journal {
+    int fd;
+    uint64_t next_lsn;
+    uint64_t synced_lsn;
+    int budget_ms;          // 0 = write and fsync inside every append
+    char *buf, *spare; int len, cap, spare_cap;
+    uint64_t buf_last_lsn;
+    struct timespec deadline;
+    bool running, flush_now;
+    pthread_mutex_t lock;
+    pthread_mutex_t io_lock; // Held around file writes and while the file is rewritten
+    bool failed;             // A write or sync failed; set and cleared under io_lock
+    uint64_t lost_lsn;       // Newest record not on disk since then (io_lock)
+    pthread_cond_t wake, synced;
+    pthread_t flusher;
+} Journal;
+
+// Periodic background snapshots. The process forks, so the child writes a
+// copy-on-write image of the trees while the gates keep running in the parent.
+typedef struct Checkpointer {
+    int interval_s;         // 0 = only on request
+    bool running, requested;
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    time_t last_done;
+    uint64_t last_lsn;
+} Checkpointer;
+
+// Leaderboards: one treap per metric, ordered highest value first and augmented with
+// subtree sizes, so top-N and rank queries cost O(log n + N) instead of a full sort.
+// Nodes are indexed by vehicle handle or space id (slot 0 is the null link). Each
+// ranking is built on first use and then kept current by the gate operations.
+// The membership and owner orderings double as secondary indexes for lookups.
+typedef struct RankNode {
+    float key;
+    int left, right, size;
+    unsigned int prio;
+    bool linked;
+} RankNode;
+
+typedef struct Ranking {
+    RankNode *nodes;
+    int cap;
+    int root;
+    bool vehicles; // Ties break on plate for vehicles, on id for spaces
+    bool by_owner; // Ordered by owner name, ignoring case, instead of by key
+    bool built;
+    unsigned int prio_state; // Treap priority generator, per ranking so lots share nothing
+} Ranking;
+
+enum { RANK_V_HRS, RANK_V_REV, RANK_S_HRS, RANK_S_REV, RANK_V_TIER, RANK_V_OWNER, NUM_RANKINGS };
+
+// Each tree has its own body layout; the shared parts (children, leaf links) sit at the
+// same offsets in both so rebalancing code serves either tree. A node is only as long as
+// its tree's layout (V_NODE_SIZE / S_NODE_SIZE), not sizeof(BPlusTreeNode).
 typedef struct BPlusTreeNode {
     int nkeys;
     bool leaf_flag;
     struct BPlusTreeNode *parent;
 
     union {
-        struct {
-            char int_vkeys[M - 1][20];       
-            int int_skeys[M - 1];          
-            struct BPlusTreeNode *child[M]; 
+        union {
+            struct BPlusTreeNode *child[MAX_ORDER]; // Only the tree's ORDER slots exist
+            struct {
+                struct BPlusTreeNode *v_child[V_ORDER];
+                PlateKey int_vkeys[V_ORDER - 1];
+            };
+            struct {
+                struct BPlusTreeNode *s_child[S_ORDER];
+                int int_skeys[S_ORDER - 1];
+            };
         } internal;
 
         struct {
-            Vehicle leaf_v[M - 1];         
-            ParkingSpace leaf_s[M - 1];    
-            struct BPlusTreeNode *next;   
-            struct BPlusTreeNode *prev;    
+            struct BPlusTreeNode *next;
+            struct BPlusTreeNode *prev;
+            union {
+                struct {
+                    PlateKey leaf_vkeys[V_ORDER - 1];
+                    VHandle leaf_vh[V_ORDER - 1];
+                };
+                ParkingSpace leaf_s[S_ORDER - 1];
+            };
         } leaf;
     } data;
 
-} BPlusTreeNode;
+} __attribute__((aligned(CACHE_LINE))) BPlusTreeNode;
+
+#define NODE_BYTES(a, b) ((((a) > (b) ? (a) : (b)) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE)
+#define V_NODE_SIZE NODE_BYTES(offsetof(BPlusTreeNode, data.internal.int_vkeys[V_ORDER - 1]), \
+                               offsetof(BPlusTreeNode, data.leaf.leaf_vh[V_ORDER - 1]))
+#define S_NODE_SIZE NODE_BYTES(offsetof(BPlusTreeNode, data.internal.int_skeys[S_ORDER - 1]), \
+                               offsetof(BPlusTreeNode, data.leaf.leaf_s[S_ORDER - 1]))
+
+#define NODE_ARENA_NODES 256 // Nodes per pool arena (144 KB of vehicle nodes, 272 KB of space nodes)
+
+typedef struct NodeArena {
+    struct NodeArena *next;
+    int used;
+    unsigned char nodes[] __attribute__((aligned(CACHE_LINE))); // NODE_ARENA_NODES of the pool's node size
+} NodeArena;
+
+// Nodes of one tree, carved in allocation order from large arenas so nodes built
+// together (a bulk-loaded level, a split and its sibling) sit together in memory.
+// Deleted nodes go on a free list for reuse; dropping the tree releases whole arenas.
+typedef struct NodePool {
+    NodeArena *arenas;        // Newest first; only the newest has unused slots
+    BPlusTreeNode *free_list; // Linked through parent
+    long narenas;
+    size_t node_size;         // V_NODE_SIZE or S_NODE_SIZE
+} NodePool;
+
+#define STAT_BUCKETS 32 // Latency bucket b counts operations taking [2^b, 2^(b+1)) ns
+
+typedef struct LatencyHist {
+    unsigned long long count; // Filled in from the buckets when read
+    unsigned long long total_ns;
+    unsigned long long buckets[STAT_BUCKETS];
+} LatencyHist;
+
+// Always-on engine counters of one lot, bumped with relaxed atomic adds. Tree shape
+// is measured when the stats are read.
+typedef struct LotStats {
+    time_t since;
+    unsigned long long v_splits, s_splits;         // Leaf and internal node splits
+    unsigned long long nodes_created;
+    unsigned long long v_descents, v_descent_cmps; // findLeafNodeV calls and their key comparisons
+    unsigned long long allocs, alloc_words;        // allocateSpace tier scans and bitmap words read
+    LatencyHist entry, exit;
+} LotStats;
+
+typedef struct Lot Lot;
+typedef void (*LotJob)(Lot *lot, void *arg);
+
+// Everything one parking lot owns: trees, record store, plate index, allocator,
+// leaderboards, journal and checkpointer, with its files in its own directory.
+// A thread works on the lot bound to it with useLot. With --pin-lots each lot
+// also gets a worker thread pinned to one core, and lotSubmit runs jobs there.
+struct Lot {
+    char name[64];
+    char dir[256]; // "" = current directory
+    BPlusTreeNode *v_root;
+    BPlusTreeNode *s_root;
+    NodePool v_pool, s_pool;
+    PlateIndex v_index;
+    SpaceAllocator s_alloc;
+    Journal journal;
+    Checkpointer checkpointer;
+    Ranking rankings[NUM_RANKINGS];
+    LotStats stats;
+    // Gates hold state_lock shared plus the stripe of their plate, and claim spaces with
+    // atomic bitmap updates. Registering a plate, deleting records and forking a checkpoint
+    // hold it exclusively.
+    pthread_rwlock_t state_lock;
+    pthread_mutex_t plate_locks[PLATE_LOCKS];
+    pthread_mutex_t rank_lock;
+
+    bool has_worker, worker_stop, worker_busy;
+    int cpu;
+    pthread_t worker;
+    pthread_mutex_t q_lock;
+    pthread_cond_t q_wake, q_idle;
+    struct { LotJob fn; void *arg; } jobs[LOT_QUEUE];
+    int q_head, q_len;
+
+    VehicleStore v_store; // Last: the chunk table is large
+};
+
+Lot *lots[MAX_LOTS];
+int nlots = 0;
+__thread Lot *cur_lot = NULL;
+
+double bulk_fill = 0.9; // Share of slots filled per node when bulk loading
+int journal_budget_ms = 10; // Defaults given to each lot when it is created
+int checkpoint_every_s = 0;
+OverflowPolicy overflow_policy = OVERFLOW_NONE;
+__thread bool gate_quiet = false; // Silences per-event gate messages (journal replay)
+
+void statAdd(unsigned long long *counter, unsigned long long n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+uint64_t monoNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void histRecord(LatencyHist *h, uint64_t ns) {
+    int b = ns ? 63 - __builtin_clzll(ns) : 0;
+    if (b >= STAT_BUCKETS) b = STAT_BUCKETS - 1;
+    statAdd(&h->total_ns, ns);
+    statAdd(&h->buckets[b], 1);
+}
+
+void gateLog(const char *fmt, ...) {
+    if (!gate_quiet) {
+        va_list ap;
+        va_start(ap, fmt);
+        vprintf(fmt, ap);
+        va_end(ap);
+    }
+}
+
+void useLot(Lot *lot) {
+    cur_lot = lot;
+}
+
+// Path of a file of the current lot.
+const char *lotFile(const char *name, char *buf) {
+    if (cur_lot->dir[0]) snprintf(buf, LOT_PATH_MAX, "%s/%s", cur_lot->dir, name);
+    else snprintf(buf, LOT_PATH_MAX, "%s", name);
+    return buf;
+}
+
+Lot *lotCreate(const char *dir) {
+    Lot *lot = (Lot *)calloc(1, sizeof(Lot));
+    if (!lot) {
+        perror("Err allocating lot");
+    } else {
+        snprintf(lot->dir, sizeof(lot->dir), "%s", dir);
+        const char *base = strrchr(dir, '/');
+        snprintf(lot->name, sizeof(lot->name), "%s", dir[0] ? (base && base[1] ? base + 1 : dir) : "main");
+        lot->v_store.count = 1;
+        lot->v_pool.node_size = V_NODE_SIZE;
+        lot->s_pool.node_size = S_NODE_SIZE;
+        lot->stats.since = time(NULL);
+        lot->s_alloc.overflow = overflow_policy;
+        lot->journal.fd = -1;
+        lot->journal.next_lsn = 1;
+        lot->journal.budget_ms = journal_budget_ms;
+        pthread_mutex_init(&lot->journal.lock, NULL);
+        pthread_mutex_init(&lot->journal.io_lock, NULL);
+        pthread_cond_init(&lot->journal.wake, NULL);
+        pthread_cond_init(&lot->journal.synced, NULL);
+        lot->checkpointer.interval_s = checkpoint_every_s;
+        pthread_mutex_init(&lot->checkpointer.lock, NULL);
+        pthread_cond_init(&lot->checkpointer.wake, NULL);
+        lot->rankings[RANK_V_HRS].vehicles = true;
+        lot->rankings[RANK_V_REV].vehicles = true;
+        lot->rankings[RANK_V_TIER].vehicles = true;
+        lot->rankings[RANK_V_OWNER].vehicles = true;
+        lot->rankings[RANK_V_OWNER].by_owner = true;
+        for (int i = 0; i < NUM_RANKINGS; i++) lot->rankings[i].prio_state = 2463534242u;
+        pthread_rwlockattr_t rw_attr;
+        pthread_rwlockattr_init(&rw_attr);
+        // Checkpoints and registrations must not starve behind a steady stream of gates
+        pthread_rwlockattr_setkind_np(&rw_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+        pthread_rwlock_init(&lot->state_lock, &rw_attr);
+        pthread_rwlockattr_destroy(&rw_attr);
+        for (int i = 0; i < PLATE_LOCKS; i++) pthread_mutex_init(&lot->plate_locks[i], NULL);
+        pthread_mutex_init(&lot->rank_lock, NULL);
+        pthread_mutex_init(&lot->q_lock, NULL);
+        pthread_cond_init(&lot->q_wake, NULL);
+        pthread_cond_init(&lot->q_idle, NULL);
+    }
+    return lot;
+}
+
+// Runs the lot's jobs in order on a thread pinned to lot->cpu.
+void *lotWorker(void *arg) {
+    Lot *lot = (Lot *)arg;
+    useLot(lot);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(lot->cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        fprintf(stderr, "Warn: Cannot pin lot %s to CPU %d.\n", lot->name, lot->cpu);
+    }
+    pthread_mutex_lock(&lot->q_lock);
+    while (!lot->worker_stop || lot->q_len > 0) {
+        if (lot->q_len == 0) {
+            pthread_cond_wait(&lot->q_wake, &lot->q_lock);
+        } else {
+            LotJob fn = lot->jobs[lot->q_head].fn;
+            void *job_arg = lot->jobs[lot->q_head].arg;
+            lot->q_head = (lot->q_head + 1) % LOT_QUEUE;
+            lot->q_len--;
+            lot->worker_busy = true;
+            pthread_cond_broadcast(&lot->q_idle);
+            pthread_mutex_unlock(&lot->q_lock);
+            fn(lot, job_arg);
+            pthread_mutex_lock(&lot->q_lock);
+            lot->worker_busy = false;
+            pthread_cond_broadcast(&lot->q_idle);
+        }
+    }
+    pthread_mutex_unlock(&lot->q_lock);
+    return NULL;
+}
+
+bool startLotWorker(Lot *lot, int cpu) {
+    lot->cpu = cpu;
+    lot->worker_stop = false;
+    lot->has_worker = pthread_create(&lot->worker, NULL, lotWorker, lot) == 0;
+    if (!lot->has_worker) fprintf(stderr, "Warn: No worker thread for lot %s; its jobs run inline.\n", lot->name);
+    return lot->has_worker;
+}
+
+// Queues a job on the lot's worker, or runs it here (bound to the lot) if it has none.
+void lotSubmit(Lot *lot, LotJob fn, void *arg) {
+    if (!lot->has_worker) {
+        Lot *prev = cur_lot;
+        useLot(lot);
+        fn(lot, arg);
+        useLot(prev);
+    } else {
+        pthread_mutex_lock(&lot->q_lock);
+        while (lot->q_len == LOT_QUEUE) pthread_cond_wait(&lot->q_idle, &lot->q_lock);
+        int slot = (lot->q_head + lot->q_len) % LOT_QUEUE;
+        lot->jobs[slot].fn = fn;
+        lot->jobs[slot].arg = arg;
+        lot->q_len++;
+        pthread_cond_signal(&lot->q_wake);
+        pthread_mutex_unlock(&lot->q_lock);
+    }
+}
+
+// Blocks until every job submitted to the lot has finished.
+void lotWait(Lot *lot) {
+    if (lot->has_worker) {
+        pthread_mutex_lock(&lot->q_lock);
+        while (lot->q_len > 0 || lot->worker_busy) pthread_cond_wait(&lot->q_idle, &lot->q_lock);
+        pthread_mutex_unlock(&lot->q_lock);
+    }
+}
+
+void stopLotWorker(Lot *lot) {
+    if (lot->has_worker) {
+        pthread_mutex_lock(&lot->q_lock);
+        lot->worker_stop = true;
+        pthread_cond_signal(&lot->q_wake);
+        pthread_mutex_unlock(&lot->q_lock);
+        pthread_join(lot->worker, NULL);
+        lot->has_worker = false;
+    }
+}
+
+// Releases the lot object itself; its trees and files must already be closed.
+void lotFree(Lot *lot) {
+    stopLotWorker(lot);
+    pthread_mutex_destroy(&lot->journal.lock);
+    pthread_mutex_destroy(&lot->journal.io_lock);
+    pthread_cond_destroy(&lot->journal.wake);
+    pthread_cond_destroy(&lot->journal.synced);
+    pthread_mutex_destroy(&lot->checkpointer.lock);
+    pthread_cond_destroy(&lot->checkpointer.wake);
+    pthread_rwlock_destroy(&lot->state_lock);
+    for (int i = 0; i < PLATE_LOCKS; i++) pthread_mutex_destroy(&lot->plate_locks[i]);
+    pthread_mutex_destroy(&lot->rank_lock);
+    pthread_mutex_destroy(&lot->q_lock);
+    pthread_cond_destroy(&lot->q_wake);
+    pthread_cond_destroy(&lot->q_idle);
+    if (cur_lot == lot) useLot(NULL);
+    free(lot);
+}
+
+// Grows a heap buffer geometrically so that index `need` fits; returns false on OOM.
+bool growBuffer(void **buf, int *cap, int need, size_t elem_size) {
+    bool ok = true;
+    if (need >= *cap) {
+        int new_cap = *cap ? *cap * 2 : 256;
+        while (new_cap <= need) new_cap *= 2;
+        void *p = realloc(*buf, (size_t)new_cap * elem_size);
+        if (p) {
+            *buf = p; *cap = new_cap;
+        } else {
+            perror("Failed to grow buffer");
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+Vehicle *vstoreGet(VHandle h) {
+    return &cur_lot->v_store.chunks[h / STORE_CHUNK][h % STORE_CHUNK];
+}
+
+VHandle vstoreAdd(const Vehicle *v) {
+    VehicleStore *st = &cur_lot->v_store;
+    VHandle h = VH_NONE;
+    unsigned int c = st->count / STORE_CHUNK;
+    if (st->nfree > 0) {
+        h = st->free_list[--st->nfree];
+        *vstoreGet(h) = *v;
+    } else if (c >= STORE_MAX_CHUNKS) {
+        fprintf(stderr, "Err: Vehicle store full.\n");
+    } else {
+        if (!st->chunks[c]) {
+            st->chunks[c] = (Vehicle *)malloc(STORE_CHUNK * sizeof(Vehicle));
+        }
+        if (!st->chunks[c]) {
+            perror("Failed to allocate vehicle store chunk");
+        } else {
+            h = st->count++;
+            *vstoreGet(h) = *v;
+        }
+    }
+    return h;
+}
+
+// Returns a deleted vehicle's slot for reuse.
+void vstoreRelease(VHandle h) {
+    VehicleStore *st = &cur_lot->v_store;
+    if (growBuffer((void **)&st->free_list, &st->free_cap, st->nfree, sizeof(VHandle))) {
+        st->free_list[st->nfree++] = h;
+    }
+}
+
+void freeVehicleStore() {
+    VehicleStore *st = &cur_lot->v_store;
+    for (int c = 0; c < STORE_MAX_CHUNKS && st->chunks[c]; c++) {
+        free(st->chunks[c]);
+        st->chunks[c] = NULL;
+    }
+    st->count = 1;
+    free(st->free_list); st->free_list = NULL;
+    st->nfree = st->free_cap = 0;
+}
+
+// Sorting. Records are sorted through an array of pointers so big structs move only once,
+// using a stable merge sort that splits across threads for large inputs. Numeric report
+// keys are sorted as (key, id) pairs with an LSD radix sort and no comparator at all.
+typedef int (*CompareFn)(const void *, const void *);
 
-BPlusTreeNode *v_root = NULL;
-BPlusTreeNode *s_root = NULL;
+typedef struct SortKey {
+    float key;
+    int id;
+} SortKey;
+
+typedef struct SortTask {
+    void **a, **tmp;
+    int lo, mid, hi;
+    CompareFn cmp;
+} SortTask;
+
+void insertionSortPtrs(void **a, int n, CompareFn cmp) {
+    for (int i = 1; i < n; i++) {
+        void *x = a[i];
+        int j = i;
+        while (j > 0 && cmp(a[j - 1], x) > 0) { a[j] = a[j - 1]; j--; }
+        a[j] = x;
+    }
+}
+
+// Merges src[lo, mid) and src[mid, hi) into dst[lo, hi); ties keep the left run first.
+void mergeRuns(void **src, void **dst, int lo, int mid, int hi, CompareFn cmp) {
+    int i = lo, j = mid, k = lo;
+    if (mid < hi && mid > lo && cmp(src[mid - 1], src[mid]) <= 0) {
+        memcpy(dst + lo, src + lo, (size_t)(hi - lo) * sizeof(void *)); // Already in order
+    } else {
+        while (i < mid && j < hi) dst[k++] = (cmp(src[j], src[i]) < 0) ? src[j++] : src[i++];
+        while (i < mid) dst[k++] = src[i++];
+        while (j < hi) dst[k++] = src[j++];
+    }
+}
+
+// Bottom-up stable merge sort; tmp must hold n pointers.
+void mergeSortPtrs(void **a, void **tmp, int n, CompareFn cmp) {
+    for (int lo = 0; lo < n; lo += SORT_RUN) {
+        insertionSortPtrs(a + lo, (n - lo < SORT_RUN) ? n - lo : SORT_RUN, cmp);
+    }
+    void **src = a, **dst = tmp;
+    for (int width = SORT_RUN; width < n; width *= 2) {
+        for (int lo = 0; lo < n; lo += 2 * width) {
+            int mid = (lo + width < n) ? lo + width : n;
+            int hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+            mergeRuns(src, dst, lo, mid, hi, cmp);
+        }
+        void **t = src; src = dst; dst = t;
+    }
+    if (src != a) memcpy(a, src, (size_t)n * sizeof(void *));
+}
+
+void *sortPartWorker(void *arg) {
+    SortTask *t = (SortTask *)arg;
+    mergeSortPtrs(t->a + t->lo, t->tmp + t->lo, t->hi - t->lo, t->cmp);
+    return NULL;
+}
+
+void *mergePartWorker(void *arg) {
+    SortTask *t = (SortTask *)arg;
+    mergeRuns(t->a, t->tmp, t->lo, t->mid, t->hi, t->cmp);
+    memcpy(t->a + t->lo, t->tmp + t->lo, (size_t)(t->hi - t->lo) * sizeof(void *));
+    return NULL;
+}
 
-void swapElements(void *a, void *b, int size) {
-    char *p1 = (char *)a;
-    char *p2 = (char *)b;
-    char temp;
-    for (int i = 0; i < size; i++) {
-        temp = p1[i];
-        p1[i] = p2[i];
-        p2[i] = temp;
+// Runs tasks[1..n) on threads and tasks[0] on the caller; a task whose thread fails runs inline.
+void runSortTasks(SortTask *tasks, int n, void *(*fn)(void *)) {
+    pthread_t tids[SORT_MAX_PARTS];
+    bool started[SORT_MAX_PARTS] = { false };
+    for (int i = 1; i < n; i++) {
+        started[i] = pthread_create(&tids[i], NULL, fn, &tasks[i]) == 0;
+        if (!started[i]) fn(&tasks[i]);
+    }
+    fn(&tasks[0]);
+    for (int i = 1; i < n; i++) {
+        if (started[i]) pthread_join(tids[i], NULL);
     }
 }
 
-int partition(void *base, int low, int high, int size, int (*compare)(const void*, const void*)) {
-    void *pivot = (char *)base + high * size;
-    int i = low - 1;
+// Stable sort of n pointers: parts are sorted on separate cores, then merged pairwise in rounds.
+bool sortPointers(void **a, int n, CompareFn cmp) {
+    bool ok = true;
+    void **tmp = (n > 1) ? (void **)malloc((size_t)n * sizeof(void *)) : NULL;
+
+    if (n > 1 && !tmp) {
+        perror("Failed to allocate sort buffer");
+        ok = false;
+    } else if (n > 1) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        int nparts = 1;
+        while (nparts * 2 <= ncpu && nparts * 2 <= SORT_MAX_PARTS && n / (nparts * 2) >= SORT_PARALLEL_MIN) nparts *= 2;
+
+        if (nparts == 1) {
+            mergeSortPtrs(a, tmp, n, cmp);
+        } else {
+            SortTask tasks[SORT_MAX_PARTS];
+            for (int i = 0; i < nparts; i++) {
+                tasks[i] = (SortTask){ a, tmp, (int)((long long)n * i / nparts), 0, (int)((long long)n * (i + 1) / nparts), cmp };
+            }
+            runSortTasks(tasks, nparts, sortPartWorker);
+            for (int width = 1; width < nparts; width *= 2) {
+                int nmerges = 0;
+                for (int i = 0; i + width < nparts; i += 2 * width) {
+                    int last = (i + 2 * width < nparts) ? i + 2 * width - 1 : nparts - 1;
+                    tasks[nmerges++] = (SortTask){ a, tmp, (int)((long long)n * i / nparts), (int)((long long)n * (i + width) / nparts),
+                                                  (int)((long long)n * (last + 1) / nparts), cmp };
+                }
+                runSortTasks(tasks, nmerges, mergePartWorker);
+            }
+        }
+    }
+    free(tmp);
+    return ok;
+}
 
-    for (int j = low; j <= high - 1; j++) {
-        void *current = (char *)base + j * size;
-        if (compare(current, pivot) <= 0) {
-            i++;
-            swapElements((char *)base + i * size, current, size);
+// Stable sort of fixed-size records: pointers are sorted, then each record is moved once.
+bool sortRecords(void *base, int n, size_t size, CompareFn cmp) {
+    bool ok = true;
+    if (n > 1) {
+        void **ptrs = (void **)malloc((size_t)n * sizeof(void *));
+        char *out = (char *)malloc((size_t)n * size);
+        ok = ptrs && out;
+        if (!ok) {
+            perror("Failed to allocate sort buffers");
+        } else {
+            for (int i = 0; i < n; i++) ptrs[i] = (char *)base + (size_t)i * size;
+            ok = sortPointers(ptrs, n, cmp);
+            if (ok) {
+                for (int i = 0; i < n; i++) memcpy(out + (size_t)i * size, ptrs[i], size);
+                memcpy(base, out, (size_t)n * size);
+            }
         }
+        free(ptrs); free(out);
     }
-    swapElements((char *)base + (i + 1) * size, (char *)base + high * size, size);
-    return (i + 1);
+    return ok;
 }
 
-void quickSortRecursive(void *base, int low, int high, int size, int (*compare)(const void*, const void*)) {
-    if (low < high) {
+// Maps a float to an unsigned key whose ascending order is the float's descending order.
+uint32_t floatKeyDesc(float f) {
+    uint32_t u;
+    f += 0.0f; // -0.0 sorts with 0.0
+    memcpy(&u, &f, sizeof(u));
+    u = (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+    return ~u;
+}
 
-        int pi = partition(base, low, high, size, compare);
-        quickSortRecursive(base, low, pi - 1, size, compare);
-        quickSortRecursive(base, pi + 1, high, size, compare);
+// Stable LSD radix sort of (key, id) pairs, highest key first. Passes where every key
+// shares the same byte are skipped, so narrow value ranges cost fewer passes.
+bool sortKeysDesc(SortKey *keys, int n) {
+    bool ok = true;
+    SortKey *tmp = (n > 1) ? (SortKey *)malloc((size_t)n * sizeof(SortKey)) : NULL;
+
+    if (n > 1 && !tmp) {
+        perror("Failed to allocate sort buffer");
+        ok = false;
+    } else if (n > 1) {
+        SortKey *src = keys, *dst = tmp;
+        for (int shift = 0; shift < 32; shift += 8) {
+            int count[256] = { 0 };
+            for (int i = 0; i < n; i++) count[(floatKeyDesc(src[i].key) >> shift) & 0xFF]++;
+            bool single = false;
+            for (int b = 0; b < 256 && !single; b++) single = count[b] == n;
+            if (!single) {
+                int pos = 0;
+                for (int b = 0; b < 256; b++) { int c = count[b]; count[b] = pos; pos += c; }
+                for (int i = 0; i < n; i++) dst[count[(floatKeyDesc(src[i].key) >> shift) & 0xFF]++] = src[i];
+                SortKey *t = src; src = dst; dst = t;
+            }
+        }
+        if (src != keys) memcpy(keys, src, (size_t)n * sizeof(SortKey));
     }
+    free(tmp);
+    return ok;
 }
 
-void quickSort(void *base, int num, int size, int (*compare)(const void*, const void*)) {
-    if (num > 1) {
-        quickSortRecursive(base, 0, num - 1, size, compare);
+// Word-at-a-time checksum; `h` carries state across calls.
+uint64_t checksum(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t w;
+    for (; len >= 8; len -= 8, p += 8) {
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0x100000001b3ULL;
+        h ^= h >> 29;
     }
+    for (; len > 0; len--, p++) h = (h ^ *p) * 0x100000001b3ULL;
+    return h;
+}
+
+// Record-by-record, matching how the save path accumulates it.
+uint64_t checksumRecords(const void *base, uint64_t n, size_t rec_size) {
+    uint64_t h = CHECKSUM_SEED;
+    for (uint64_t i = 0; i < n; i++) h = checksum(h, (const char *)base + i * rec_size, rec_size);
+    return h;
 }
 
 Vehicle* findVehicle(BPlusTreeNode *node, const char *v_num);
 ParkingSpace* findSpace(BPlusTreeNode *node, int s_id);
-BPlusTreeNode* findLeafNodeV(BPlusTreeNode* node, const char* v_num);
+BPlusTreeNode* findLeafNodeV(BPlusTreeNode* node, PlateKey code);
 BPlusTreeNode* findLeafNodeS(BPlusTreeNode* node, int s_id);
-void insertVehicle(Vehicle v);
-void insertSpace(ParkingSpace s);
-void collectVehicles(BPlusTreeNode *node, Vehicle *v_arr, int *cnt);
-void collectSpaces(BPlusTreeNode *node, ParkingSpace *s_arr, int *cnt);
+VHandle insertVehicle(Vehicle v);
+bool insertSpace(ParkingSpace s);
 void saveDataAndFree();
+void closeAllLots(bool save);
+void requestCheckpoint();
 int compareSpacesByID(const void *a, const void *b);
 void loadSpaces();
 void loadVehicles();
+void showStats();
+void rankVehicleChanged(VHandle h);
+void rankDrop(Ranking *r, int id);
+bool isParked(const Vehicle *v);
+
+// Packs up to 12 plate characters into base 37 (0 ends the plate, digits 1-10,
+// letters 11-36) above a flag bit, so integer order matches strcmp order. A
+// character outside 0-9/A-Z takes the rank of the nearest standard character
+// below it and the rest of the code is filled with the top symbol; such codes
+// and codes of longer plates set PLATE_INEXACT and are only an ordering hint.
+PlateKey encodePlate(const char *plate) {
+    PlateKey v = 0;
+    bool exact = true, ended = false;
+    int fill = -1;
+    for (int i = 0; i < PLATE_SYMBOLS; i++) {
+        int sym = 0;
+        unsigned char c = (ended || fill >= 0) ? 0 : (unsigned char)plate[i];
+        if (fill >= 0) sym = fill;
+        else if (c == '\0') ended = true;
+        else if (c >= '0' && c <= '9') sym = 1 + (c - '0');
+        else if (c >= 'A' && c <= 'Z') sym = 11 + (c - 'A');
+        else {
+            sym = (c < '0') ? 0 : (c < 'A') ? 10 : 36;
+            fill = 36;
+            exact = false;
+        }
+        v = v * 37 + (PlateKey)sym;
+    }
+    if (!ended && fill < 0 && plate[PLATE_SYMBOLS] != '\0') exact = false;
+    return (v << 1) | (exact ? 0 : PLATE_INEXACT);
+}
+
+// Writes the plate of an exact code into out (at least PLATE_SYMBOLS + 1 bytes).
+bool decodePlate(PlateKey code, char *out) {
+    bool ok = !(code & PLATE_INEXACT);
+    if (ok) {
+        PlateKey v = code >> 1;
+        char syms[PLATE_SYMBOLS];
+        for (int i = PLATE_SYMBOLS - 1; i >= 0; i--) {
+            syms[i] = (char)(v % 37);
+            v /= 37;
+        }
+        int n = 0;
+        while (n < PLATE_SYMBOLS && syms[n]) {
+            out[n] = (syms[n] <= 10) ? (char)('0' + syms[n] - 1) : (char)('A' + syms[n] - 11);
+            n++;
+        }
+        out[n] = '\0';
+    }
+    return ok;
+}
+
+// Orders a leaf entry against a plate. The record text is read only when two
+// inexact codes tie.
+int compareVKey(PlateKey entry, VHandle h, PlateKey code, const char *v_num) {
+    int cmp = (entry > code) - (entry < code);
+    if (cmp == 0 && (code & PLATE_INEXACT)) cmp = strcmp(vstoreGet(h)->v_num, v_num);
+    return cmp;
+}
+
+uint32_t plateHash(PlateKey code, const char *v_num) {
+    uint64_t x = (code & PLATE_INEXACT) ? checksum(CHECKSUM_SEED, v_num, strlen(v_num)) : code;
+    x ^= x >> 33; x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return (uint32_t)x;
+}
+
+// Keeps the load factor of the index at or below 70% for n entries.
+bool pindexReserve(PlateIndex *ix, uint32_t n) {
+    bool ok = true;
+    uint64_t cap = ix->slots ? (uint64_t)ix->mask + 1 : 0;
+    if ((uint64_t)n * 10 > cap * 7) {
+        uint64_t new_cap = PINDEX_MIN_SLOTS;
+        while ((uint64_t)n * 10 > new_cap * 7) new_cap *= 2;
+        PlateSlot *slots = (PlateSlot *)calloc(new_cap, sizeof(PlateSlot));
+        if (!slots) {
+            fprintf(stderr, "Err: Cannot grow the plate index to %llu slots.\n", (unsigned long long)new_cap);
+            ok = false;
+        } else {
+            uint32_t new_mask = (uint32_t)(new_cap - 1);
+            for (uint64_t i = 0; i < cap; i++) {
+                if (ix->slots[i].h != VH_NONE) {
+                    uint32_t j = ix->slots[i].hash & new_mask;
+                    while (slots[j].h != VH_NONE) j = (j + 1) & new_mask;
+                    slots[j] = ix->slots[i];
+                }
+            }
+            free(ix->slots);
+            ix->slots = slots;
+            ix->mask = new_mask;
+        }
+    }
+    return ok;
+}
+
+// Slot holding the plate, or the empty slot that ends its probe run.
+uint32_t pindexProbe(const PlateIndex *ix, const char *v_num, PlateKey code, uint32_t hash) {
+    uint32_t i = hash & ix->mask;
+    bool done = false;
+    while (!done) {
+        const PlateSlot *s = &ix->slots[i];
+        if (s->h == VH_NONE) {
+            done = true;
+        } else if (s->hash == hash && s->code == code &&
+                   (!(code & PLATE_INEXACT) || strcmp(vstoreGet(s->h)->v_num, v_num) == 0)) {
+            done = true;
+        } else {
+            i = (i + 1) & ix->mask;
+        }
+    }
+    return i;
+}
+
+VHandle pindexFind(const PlateIndex *ix, const char *v_num, PlateKey code) {
+    VHandle h = VH_NONE;
+    if (ix->slots) h = ix->slots[pindexProbe(ix, v_num, code, plateHash(code, v_num))].h;
+    return h;
+}
+
+// The plate must not be in the index yet.
+bool pindexPut(PlateIndex *ix, const char *v_num, PlateKey code, VHandle h) {
+    bool ok = pindexReserve(ix, ix->count + 1);
+    if (ok) {
+        uint32_t hash = plateHash(code, v_num);
+        uint32_t i = pindexProbe(ix, v_num, code, hash);
+        ix->slots[i] = (PlateSlot){ code, hash, h };
+        ix->count++;
+    }
+    return ok;
+}
+
+bool pindexRemove(PlateIndex *ix, const char *v_num, PlateKey code) {
+    bool found = false;
+    if (ix->slots) {
+        uint32_t i = pindexProbe(ix, v_num, code, plateHash(code, v_num));
+        found = ix->slots[i].h != VH_NONE;
+        if (found) {
+            // Pull back every later entry of the run that may sit at or before the hole.
+            uint32_t j = i;
+            bool end = false;
+            while (!end) {
+                j = (j + 1) & ix->mask;
+                if (ix->slots[j].h == VH_NONE) {
+                    end = true;
+                } else {
+                    uint32_t home = ix->slots[j].hash & ix->mask;
+                    if (((j - home) & ix->mask) >= ((j - i) & ix->mask)) {
+                        ix->slots[i] = ix->slots[j];
+                        i = j;
+                    }
+                }
+            }
+            ix->slots[i].h = VH_NONE;
+            ix->count--;
+        }
+    }
+    return found;
+}
+
+void freePlateIndex(PlateIndex *ix) {
+    free(ix->slots);
+    ix->slots = NULL;
+    ix->mask = ix->count = 0;
+}
+
+// Stores a new record and indexes its plate; the caller links it into the tree.
+VHandle addVehicleRecord(const Vehicle *v, PlateKey code) {
+    VHandle h = vstoreAdd(v);
+    if (h != VH_NONE && !pindexPut(&cur_lot->v_index, v->v_num, code, h)) {
+        vstoreRelease(h);
+        h = VH_NONE;
+    }
+    return h;
+}
+
+// Undoes addVehicleRecord when the record could not be linked into the tree.
+void dropVehicleRecord(VHandle h, const char *v_num, PlateKey code) {
+    pindexRemove(&cur_lot->v_index, v_num, code);
+    vstoreRelease(h);
+}
 
-BPlusTreeNode *createNode(bool is_leaf) {
-    BPlusTreeNode *node = (BPlusTreeNode *)calloc(1, sizeof(BPlusTreeNode));
+NodePool *treePool(bool vehicles) {
+    return vehicles ? &cur_lot->v_pool : &cur_lot->s_pool;
+}
+
+BPlusTreeNode *createNode(NodePool *pool, bool is_leaf) {
+    BPlusTreeNode *node = pool->free_list;
+    if (node) {
+        pool->free_list = node->parent;
+    } else {
+        if (!pool->arenas || pool->arenas->used == NODE_ARENA_NODES) {
+            NodeArena *a = (NodeArena *)aligned_alloc(CACHE_LINE, sizeof(NodeArena) + NODE_ARENA_NODES * pool->node_size);
+            if (a) {
+                a->next = pool->arenas;
+                a->used = 0;
+                pool->arenas = a;
+                pool->narenas++;
+            }
+        }
+        if (pool->arenas && pool->arenas->used < NODE_ARENA_NODES) {
+            node = (BPlusTreeNode *)(pool->arenas->nodes + pool->arenas->used++ * pool->node_size);
+        }
+    }
     if (node) {
+       memset(node, 0, pool->node_size);
        node->leaf_flag = is_leaf;
+       statAdd(&cur_lot->stats.nodes_created, 1);
     } else {
        perror("Failed to allocate node in createNode");
 
@@ -121,17 +991,128 @@ BPlusTreeNode *createNode(bool is_leaf) {
     return node;
 }
 
+void freeNode(NodePool *pool, BPlusTreeNode *node) {
+    node->parent = pool->free_list;
+    pool->free_list = node;
+}
+
+#define SPLIT_MAX_NODES 64 // More levels than any tree of these orders can reach
+
+void releaseSpare(NodePool *pool, BPlusTreeNode **spare, int *nspare) {
+    while (*nspare > 0) freeNode(pool, spare[--*nspare]);
+}
+
+// Allocates every node a split of leaf can take: the new leaf, one per full ancestor and
+// a new root if the split reaches it. Done before the tree changes, so a failure leaves it intact.
+bool reserveSplit(NodePool *pool, const BPlusTreeNode *leaf, int order, BPlusTreeNode **spare, int *nspare) {
+    int need = 1;
+    const BPlusTreeNode *p = leaf->parent;
+    while (p && p->nkeys == order - 1) { need++; p = p->parent; }
+    if (!p) need++;
+    bool ok = need <= SPLIT_MAX_NODES;
+    *nspare = 0;
+    while (ok && *nspare < need) {
+        spare[*nspare] = createNode(pool, false);
+        if (spare[*nspare]) (*nspare)++;
+        else ok = false;
+    }
+    if (!ok) releaseSpare(pool, spare, nspare);
+    return ok;
+}
+
+BPlusTreeNode *takeSpare(BPlusTreeNode **spare, int *nspare) {
+    return (*nspare > 0) ? spare[--*nspare] : NULL;
+}
+
+// Drops a whole tree by releasing its pool's arenas; O(arenas), no tree walk.
+void freeTree(BPlusTreeNode **root, NodePool *pool) {
+    while (pool->arenas) {
+        NodeArena *next = pool->arenas->next;
+        free(pool->arenas);
+        pool->arenas = next;
+    }
+    pool->free_list = NULL;
+    pool->narenas = 0;
+    *root = NULL;
+}
+
+// Index of the child to descend into. Exact codes are unique and take the number
+// of separators <= code. Plates sharing an inexact code may straddle a separator,
+// so those take the number of separators < code and locateV walks right.
+int searchInternalV(const BPlusTreeNode *node, PlateKey code, int *cmps) {
+    PlateKey bound = (code & PLATE_INEXACT) ? code : code + 1;
+    int lo = 0, hi = node->nkeys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        (*cmps)++;
+        if (node->data.internal.int_vkeys[mid] < bound) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Same as searchInternalV for space ids; keys are compared 4 at a time with SSE2.
+int searchInternalS(const BPlusTreeNode *node, int s_id) {
+    const int *keys = node->data.internal.int_skeys;
+    int i = 0;
+#ifdef __SSE2__
+    __m128i target = _mm_set1_epi32(s_id);
+    bool done = false;
+    while (i + 4 <= node->nkeys && !done) {
+        __m128i gt = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)&keys[i]), target);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(gt));
+        if (mask) {
+            i += __builtin_ctz(mask);
+            done = true;
+        } else {
+            i += 4;
+        }
+    }
+    if (!done) {
+        while (i < node->nkeys && keys[i] <= s_id) i++;
+    }
+#else
+    int hi = node->nkeys;
+    while (i < hi) {
+        int mid = (i + hi) / 2;
+        if (keys[mid] <= s_id) i = mid + 1;
+        else hi = mid;
+    }
+#endif
+    return i;
+}
+
+// First slot in a leaf whose plate is >= v_num.
+int searchLeafV(const BPlusTreeNode *node, const char *v_num, PlateKey code) {
+    int lo = 0, hi = node->nkeys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (compareVKey(node->data.leaf.leaf_vkeys[mid], node->data.leaf.leaf_vh[mid], code, v_num) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// First slot in a leaf whose space id is >= s_id.
+int searchLeafS(const BPlusTreeNode *node, int s_id) {
+    int lo = 0, hi = node->nkeys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (node->data.leaf.leaf_s[mid].id < s_id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
 
-BPlusTreeNode* findLeafNodeV(BPlusTreeNode* node, const char* v_num) {
+BPlusTreeNode* findLeafNodeV(BPlusTreeNode* node, PlateKey code) {
     BPlusTreeNode* result = NULL;
     if (node) {
         BPlusTreeNode* curr = node;
         bool error_occurred = false;
+        int cmps = 0;
         while (!curr->leaf_flag && !error_occurred) {
-            int i = 0;
-            while (i < curr->nkeys && strcmp(curr->data.internal.int_vkeys[i], v_num) <= 0) {
-                i++;
-            }
+            int i = searchInternalV(curr, code, &cmps);
 
             if (i <= curr->nkeys && curr->data.internal.child[i]) {
                 curr = curr->data.internal.child[i];
@@ -146,13 +1127,37 @@ BPlusTreeNode* findLeafNodeV(BPlusTreeNode* node, const char* v_num) {
         if (!error_occurred && curr->leaf_flag) {
             result = curr;
         }
-
+        statAdd(&cur_lot->stats.v_descents, 1);
+        statAdd(&cur_lot->stats.v_descent_cmps, (unsigned long long)cmps);
     }
 
 
     return result;
 }
 
+// Leaf and slot where v_num is or would be inserted. An inexact code may
+// continue into the following leaves, so the walk goes on while the next leaf
+// starts at or before v_num.
+BPlusTreeNode *locateV(BPlusTreeNode *root, const char *v_num, PlateKey code, int *pos) {
+    BPlusTreeNode *leaf = findLeafNodeV(root, code);
+    int i = 0;
+    if (leaf) {
+        i = searchLeafV(leaf, v_num, code);
+        while ((code & PLATE_INEXACT) && i == leaf->nkeys && leaf->data.leaf.next &&
+               compareVKey(leaf->data.leaf.next->data.leaf.leaf_vkeys[0],
+                           leaf->data.leaf.next->data.leaf.leaf_vh[0], code, v_num) <= 0) {
+            leaf = leaf->data.leaf.next;
+            i = searchLeafV(leaf, v_num, code);
+        }
+    }
+    *pos = i;
+    return leaf;
+}
+
+bool leafHoldsV(const BPlusTreeNode *leaf, int i, const char *v_num, PlateKey code) {
+    return i < leaf->nkeys && compareVKey(leaf->data.leaf.leaf_vkeys[i], leaf->data.leaf.leaf_vh[i], code, v_num) == 0;
+}
+
 
 BPlusTreeNode* findLeafNodeS(BPlusTreeNode* node, int s_id) {
     BPlusTreeNode* result = NULL;
@@ -160,10 +1165,7 @@ BPlusTreeNode* findLeafNodeS(BPlusTreeNode* node, int s_id) {
         BPlusTreeNode* curr = node;
         bool error_occurred = false;
         while (!curr->leaf_flag && !error_occurred) {
-            int i = 0;
-            while (i < curr->nkeys && curr->data.internal.int_skeys[i] <= s_id) {
-                i++;
-            }
+            int i = searchInternalS(curr, s_id);
              if (i <= curr->nkeys && curr->data.internal.child[i]) {
                  curr = curr->data.internal.child[i];
              } else {
@@ -183,136 +1185,156 @@ BPlusTreeNode* findLeafNodeS(BPlusTreeNode* node, int s_id) {
     return result;
 }
 
-void insertIntoLeafV(BPlusTreeNode* l_node, Vehicle v);
-void insertIntoParentV(BPlusTreeNode* left, const char* k, BPlusTreeNode* right);
+void insertIntoLeafV(BPlusTreeNode* l_node, int pos, PlateKey k, VHandle h);
+bool insertIntoParentV(BPlusTreeNode* left, PlateKey k, BPlusTreeNode* right, BPlusTreeNode **spare, int *nspare);
 void insertIntoLeafS(BPlusTreeNode* l_node, ParkingSpace s);
-void insertIntoParentS(BPlusTreeNode* left, int k, BPlusTreeNode* right);
+bool insertIntoParentS(BPlusTreeNode* left, int k, BPlusTreeNode* right, BPlusTreeNode **spare, int *nspare);
 
 
-void insertIntoLeafV(BPlusTreeNode* l_node, Vehicle v) {
-    int i = l_node->nkeys - 1;
-    while (i >= 0 && strcmp(l_node->data.leaf.leaf_v[i].v_num, v.v_num) > 0) {
-        l_node->data.leaf.leaf_v[i + 1] = l_node->data.leaf.leaf_v[i];
-        i--;
-    }
-    l_node->data.leaf.leaf_v[i + 1] = v;
+void insertIntoLeafV(BPlusTreeNode* l_node, int pos, PlateKey k, VHandle h) {
+    memmove(&l_node->data.leaf.leaf_vkeys[pos + 1], &l_node->data.leaf.leaf_vkeys[pos],
+            (l_node->nkeys - pos) * sizeof(l_node->data.leaf.leaf_vkeys[0]));
+    memmove(&l_node->data.leaf.leaf_vh[pos + 1], &l_node->data.leaf.leaf_vh[pos],
+            (l_node->nkeys - pos) * sizeof(VHandle));
+    l_node->data.leaf.leaf_vkeys[pos] = k;
+    l_node->data.leaf.leaf_vh[pos] = h;
     l_node->nkeys++;
 }
 
 
-void insertIntoParentV(BPlusTreeNode* left, const char* k, BPlusTreeNode* right) {
+// Nodes come from the spare reserved by reserveSplit; returns false only if it ran short.
+bool insertIntoParentV(BPlusTreeNode* left, PlateKey k, BPlusTreeNode* right, BPlusTreeNode **spare, int *nspare) {
+    bool ok = true;
     if (!left) {
         fprintf(stderr, "Error: insertIntoParentV called with NULL left child.\n");
+        ok = false;
     } else {
         BPlusTreeNode* p = left->parent;
         bool processed = false;
 
         if (p == NULL) {
-            BPlusTreeNode* new_root_node = createNode(false);
+            BPlusTreeNode* new_root_node = takeSpare(spare, nspare);
 
             if (new_root_node) {
-                strcpy(new_root_node->data.internal.int_vkeys[0], k);
+                new_root_node->data.internal.int_vkeys[0] = k;
                 new_root_node->data.internal.child[0] = left;
                 new_root_node->data.internal.child[1] = right;
                 new_root_node->nkeys = 1;
                 if(left) left->parent = new_root_node;
                 if(right) right->parent = new_root_node;
-                v_root = new_root_node;
+                cur_lot->v_root = new_root_node;
             } else {
-                 fprintf(stderr, "Error: Failed to allocate new root node in insertIntoParentV.\n");
+                 fprintf(stderr, "Error: No reserved node for a new root in insertIntoParentV.\n");
+                 ok = false;
             }
             processed = true;
 
         }
 
-        if (!processed && p->nkeys < M - 1) {
-            int i = p->nkeys - 1;
-            while (i >= 0 && strcmp(p->data.internal.int_vkeys[i], k) > 0) {
-                strcpy(p->data.internal.int_vkeys[i + 1], p->data.internal.int_vkeys[i]);
-                p->data.internal.child[i + 2] = p->data.internal.child[i + 1];
-                i--;
-            }
-            strcpy(p->data.internal.int_vkeys[i + 1], k);
-            p->data.internal.child[i + 2] = right;
+        // Separators can repeat, so the slot comes from left's position, not the key.
+        int pos = 0;
+        if (!processed) {
+            while (p->data.internal.child[pos] != left) pos++;
+        }
+
+        if (!processed && p->nkeys < V_ORDER - 1) {
+            memmove(&p->data.internal.int_vkeys[pos + 1], &p->data.internal.int_vkeys[pos],
+                    (p->nkeys - pos) * sizeof(p->data.internal.int_vkeys[0]));
+            memmove(&p->data.internal.child[pos + 2], &p->data.internal.child[pos + 1],
+                    (p->nkeys - pos) * sizeof(BPlusTreeNode *));
+            p->data.internal.int_vkeys[pos] = k;
+            p->data.internal.child[pos + 1] = right;
             if (right) right->parent = p;
             p->nkeys++;
             processed = true;
         }
 
         if (!processed) {
-            BPlusTreeNode* new_node = createNode(false);
+            BPlusTreeNode* new_node = takeSpare(spare, nspare);
             if (!new_node) {
 
-                 fprintf(stderr, "Error: Failed to allocate new internal node in insertIntoParentV.\n");
+                 fprintf(stderr, "Error: No reserved node for an internal split in insertIntoParentV.\n");
+                 ok = false;
                  processed = true;
             } else {
-                char tmp_k[M][20]; BPlusTreeNode* tmp_c[M + 1]; int i = 0, j = 0;
+                statAdd(&cur_lot->stats.v_splits, 1);
+                PlateKey tmp_k[V_ORDER]; BPlusTreeNode* tmp_c[V_ORDER + 1]; int i = 0, j = 0;
 
 
-                while (i < p->nkeys && strcmp(p->data.internal.int_vkeys[i], k) < 0) {
-                    strcpy(tmp_k[j], p->data.internal.int_vkeys[i]); tmp_c[j] = p->data.internal.child[i]; i++; j++;
+                while (i < pos) {
+                    tmp_k[j] = p->data.internal.int_vkeys[i]; tmp_c[j] = p->data.internal.child[i]; i++; j++;
                 }
-                strcpy(tmp_k[j], k); tmp_c[j] = p->data.internal.child[i]; tmp_c[j + 1] = right; j++;
+                tmp_k[j] = k; tmp_c[j] = p->data.internal.child[i]; tmp_c[j + 1] = right; j++;
                 while (i < p->nkeys) {
-                     strcpy(tmp_k[j], p->data.internal.int_vkeys[i]); tmp_c[j + 1] = p->data.internal.child[i + 1]; i++; j++;
+                     tmp_k[j] = p->data.internal.int_vkeys[i]; tmp_c[j + 1] = p->data.internal.child[i + 1]; i++; j++;
                 }
-                int split_idx = M / 2; char up_key[20]; strcpy(up_key, tmp_k[split_idx]);
+                int split_idx = V_ORDER / 2; PlateKey up_key = tmp_k[split_idx];
 
 
                 p->nkeys = split_idx;
                 memset(p->data.internal.int_vkeys, 0, sizeof(p->data.internal.int_vkeys));
-                memset(p->data.internal.child, 0, sizeof(p->data.internal.child));
+                memset(p->data.internal.v_child, 0, sizeof(p->data.internal.v_child));
                 for(i=0; i < p->nkeys; ++i) {
-                    strcpy(p->data.internal.int_vkeys[i], tmp_k[i]);
+                    p->data.internal.int_vkeys[i] = tmp_k[i];
                     p->data.internal.child[i] = tmp_c[i];
                     if(p->data.internal.child[i]) p->data.internal.child[i]->parent = p;
                 }
                 p->data.internal.child[p->nkeys] = tmp_c[split_idx];
                 if(p->data.internal.child[p->nkeys]) p->data.internal.child[p->nkeys]->parent = p;
 
-                new_node->nkeys = M - 1 - p->nkeys;
+                new_node->nkeys = V_ORDER - 1 - p->nkeys;
                 new_node->parent = p->parent;
-                memset(new_node->data.internal.int_vkeys, 0, sizeof(new_node->data.internal.int_vkeys));
-                memset(new_node->data.internal.child, 0, sizeof(new_node->data.internal.child));
                 for(i=0, j=split_idx + 1; i < new_node->nkeys; ++i, ++j) {
-                    strcpy(new_node->data.internal.int_vkeys[i], tmp_k[j]);
+                    new_node->data.internal.int_vkeys[i] = tmp_k[j];
                     new_node->data.internal.child[i] = tmp_c[j];
                     if(new_node->data.internal.child[i]) new_node->data.internal.child[i]->parent = new_node;
                 }
-                new_node->data.internal.child[new_node->nkeys] = tmp_c[M];
+                new_node->data.internal.child[new_node->nkeys] = tmp_c[V_ORDER];
                 if(new_node->data.internal.child[new_node->nkeys]) new_node->data.internal.child[new_node->nkeys]->parent = new_node;
 
 
-                for(i = p->nkeys + 1; i <= M; ++i) p->data.internal.child[i] = NULL;
-                for(i = new_node->nkeys + 1; i <= M; ++i) new_node->data.internal.child[i] = NULL;
-
-
-                insertIntoParentV(p, up_key, new_node);
+                ok = insertIntoParentV(p, up_key, new_node, spare, nspare);
 
             }
         }
     }
-
+    return ok;
 }
 
 
-void insertVehicle(Vehicle v) {
+// Returns the record's handle; an existing plate is overwritten in place.
+VHandle insertVehicle(Vehicle v) {
     bool proceed = true;
+    PlateKey code = encodePlate(v.v_num);
+    VHandle h = pindexFind(&cur_lot->v_index, v.v_num, code);
+
+    if (h != VH_NONE) {
+        rankDrop(&cur_lot->rankings[RANK_V_OWNER], (int)h);
+        *vstoreGet(h) = v;
+        rankVehicleChanged(h);
+        proceed = false;
+    }
 
-    if (v_root == NULL) {
-        v_root = createNode(true);
-        if (v_root) {
-            v_root->data.leaf.leaf_v[0] = v;
-            v_root->nkeys = 1;
+    if (proceed && cur_lot->v_root == NULL) {
+        h = addVehicleRecord(&v, code);
+        cur_lot->v_root = (h != VH_NONE) ? createNode(&cur_lot->v_pool, true) : NULL;
+        if (cur_lot->v_root) {
+            cur_lot->v_root->data.leaf.leaf_vkeys[0] = code;
+            cur_lot->v_root->data.leaf.leaf_vh[0] = h;
+            cur_lot->v_root->nkeys = 1;
+            rankVehicleChanged(h);
         } else {
             fprintf(stderr, "Error: Failed to create root node for vehicles.\n");
+            if (h != VH_NONE) dropVehicleRecord(h, v.v_num, code);
+            h = VH_NONE;
         }
         proceed = false;
     }
 
     BPlusTreeNode* l_node = NULL;
+    int pos = 0;
     if (proceed) {
-        l_node = findLeafNodeV(v_root, v.v_num);
+        l_node = locateV(cur_lot->v_root, v.v_num, code, &pos);
         if (!l_node) {
             fprintf(stderr, "  insertV: Failed find leaf for %s\n", v.v_num);
             proceed = false;
@@ -320,53 +1342,50 @@ void insertVehicle(Vehicle v) {
         }
     }
 
-    bool found = false;
     if (proceed) {
-        int i = 0;
-        while(i < l_node->nkeys && !found) {
-             if (strcmp(l_node->data.leaf.leaf_v[i].v_num, v.v_num) == 0) {
-                 l_node->data.leaf.leaf_v[i] = v;
-                 found = true;
-             }
-             i++;
-         }
-        if(found) {
-            proceed = false;
-        }
+        h = addVehicleRecord(&v, code);
+        if (h == VH_NONE) proceed = false;
     }
 
     if (proceed) {
-        if (l_node->nkeys < M - 1) {
-            insertIntoLeafV(l_node, v);
+        if (l_node->nkeys < V_ORDER - 1) {
+            insertIntoLeafV(l_node, pos, code, h);
         } else {
-            BPlusTreeNode* new_l = createNode(true);
-            if (!new_l) {
-                 printf("Failed alloc new_leaf!\n");
-
+            BPlusTreeNode *spare[SPLIT_MAX_NODES];
+            int nspare = 0;
+            BPlusTreeNode* new_l = NULL;
+            if (reserveSplit(&cur_lot->v_pool, l_node, V_ORDER, spare, &nspare)) {
+                new_l = takeSpare(spare, &nspare);
+                new_l->leaf_flag = true;
+            } else {
+                 fprintf(stderr, "Err: Cannot allocate nodes to split for %s.\n", v.v_num);
+                 dropVehicleRecord(h, v.v_num, code);
+                 h = VH_NONE;
                  proceed = false;
             }
 
             if (proceed) {
-                Vehicle tmp_v[M];
+                statAdd(&cur_lot->stats.v_splits, 1);
+                PlateKey tmp_k[V_ORDER]; VHandle tmp_h[V_ORDER];
                 int i = 0, j = 0;
 
-                while (i < l_node->nkeys && strcmp(l_node->data.leaf.leaf_v[i].v_num, v.v_num) < 0) {
-                    tmp_v[j++] = l_node->data.leaf.leaf_v[i++];
+                while (i < pos) {
+                    tmp_k[j] = l_node->data.leaf.leaf_vkeys[i]; tmp_h[j++] = l_node->data.leaf.leaf_vh[i++];
                 }
-                tmp_v[j++] = v;
+                tmp_k[j] = code; tmp_h[j++] = h;
                 while (i < l_node->nkeys) {
-                    tmp_v[j++] = l_node->data.leaf.leaf_v[i++];
+                    tmp_k[j] = l_node->data.leaf.leaf_vkeys[i]; tmp_h[j++] = l_node->data.leaf.leaf_vh[i++];
                 }
-                int split_pt = (int)ceil((double)M / 2.0);
+                int split_pt = (int)ceil((double)V_ORDER / 2.0);
 
 
                 l_node->nkeys = split_pt;
-                memset(l_node->data.leaf.leaf_v, 0, sizeof(l_node->data.leaf.leaf_v));
-                for (i = 0; i < l_node->nkeys; i++) { l_node->data.leaf.leaf_v[i] = tmp_v[i]; }
+                memcpy(l_node->data.leaf.leaf_vkeys, tmp_k, split_pt * sizeof(tmp_k[0]));
+                memcpy(l_node->data.leaf.leaf_vh, tmp_h, split_pt * sizeof(VHandle));
 
-                new_l->nkeys = M - split_pt;
-                memset(new_l->data.leaf.leaf_v, 0, sizeof(new_l->data.leaf.leaf_v));
-                for (i = 0, j = split_pt; i < new_l->nkeys; i++, j++) { new_l->data.leaf.leaf_v[i] = tmp_v[j]; }
+                new_l->nkeys = V_ORDER - split_pt;
+                memcpy(new_l->data.leaf.leaf_vkeys, &tmp_k[split_pt], new_l->nkeys * sizeof(tmp_k[0]));
+                memcpy(new_l->data.leaf.leaf_vh, &tmp_h[split_pt], new_l->nkeys * sizeof(VHandle));
 
 
                 new_l->data.leaf.next = l_node->data.leaf.next;
@@ -376,33 +1395,38 @@ void insertVehicle(Vehicle v) {
                 new_l->parent = l_node->parent;
 
 
-                insertIntoParentV(l_node, new_l->data.leaf.leaf_v[0].v_num, new_l);
+                proceed = insertIntoParentV(l_node, new_l->data.leaf.leaf_vkeys[0], new_l, spare, &nspare);
+                if (!proceed) h = VH_NONE;
+                releaseSpare(&cur_lot->v_pool, spare, &nspare);
             }
         }
+        if (proceed) rankVehicleChanged(h);
     }
 
+    return h;
 }
 
 
 void insertIntoLeafS(BPlusTreeNode* l_node, ParkingSpace s) {
-    int i = l_node->nkeys - 1;
-    while (i >= 0 && l_node->data.leaf.leaf_s[i].id > s.id) {
-        l_node->data.leaf.leaf_s[i + 1] = l_node->data.leaf.leaf_s[i];
-        i--;
-    }
-    l_node->data.leaf.leaf_s[i + 1] = s;
+    int pos = searchLeafS(l_node, s.id);
+    memmove(&l_node->data.leaf.leaf_s[pos + 1], &l_node->data.leaf.leaf_s[pos],
+            (l_node->nkeys - pos) * sizeof(ParkingSpace));
+    l_node->data.leaf.leaf_s[pos] = s;
     l_node->nkeys++;
 }
 
-void insertIntoParentS(BPlusTreeNode* left, int k, BPlusTreeNode* right) {
+// Nodes come from the spare reserved by reserveSplit; returns false only if it ran short.
+bool insertIntoParentS(BPlusTreeNode* left, int k, BPlusTreeNode* right, BPlusTreeNode **spare, int *nspare) {
+    bool ok = true;
      if (!left) {
          fprintf(stderr, "Error: insertIntoParentS called with NULL left child.\n");
+         ok = false;
      } else {
          BPlusTreeNode* p = left->parent;
          bool processed = false;
 
         if (p == NULL) {
-            BPlusTreeNode* new_root_node = createNode(false);
+            BPlusTreeNode* new_root_node = takeSpare(spare, nspare);
             if (new_root_node) { // Check allocation
                 new_root_node->data.internal.int_skeys[0] = k;
                 new_root_node->data.internal.child[0] = left;
@@ -410,37 +1434,39 @@ void insertIntoParentS(BPlusTreeNode* left, int k, BPlusTreeNode* right) {
                 new_root_node->nkeys = 1;
                 if (left) left->parent = new_root_node;
                 if (right) right->parent = new_root_node;
-                s_root = new_root_node;
+                cur_lot->s_root = new_root_node;
             } else {
-                fprintf(stderr, "Error: Failed to allocate new root node in insertIntoParentS.\n");
+                fprintf(stderr, "Error: No reserved node for a new root in insertIntoParentS.\n");
+                ok = false;
             }
             processed = true;
 
         }
 
-        if (!processed && p->nkeys < M - 1) {
-            int i = p->nkeys - 1;
-            while (i >= 0 && p->data.internal.int_skeys[i] > k) {
-                p->data.internal.int_skeys[i + 1] = p->data.internal.int_skeys[i];
-                p->data.internal.child[i + 2] = p->data.internal.child[i + 1];
-                i--;
-            }
-            p->data.internal.int_skeys[i + 1] = k;
-            p->data.internal.child[i + 2] = right;
+        if (!processed && p->nkeys < S_ORDER - 1) {
+            int pos = searchInternalS(p, k);
+            memmove(&p->data.internal.int_skeys[pos + 1], &p->data.internal.int_skeys[pos],
+                    (p->nkeys - pos) * sizeof(int));
+            memmove(&p->data.internal.child[pos + 2], &p->data.internal.child[pos + 1],
+                    (p->nkeys - pos) * sizeof(BPlusTreeNode *));
+            p->data.internal.int_skeys[pos] = k;
+            p->data.internal.child[pos + 1] = right;
             if (right) right->parent = p;
             p->nkeys++;
             processed = true;
         }
 
         if (!processed) {
-            BPlusTreeNode* new_node = createNode(false);
+            BPlusTreeNode* new_node = takeSpare(spare, nspare);
             if (!new_node) {
-                 fprintf(stderr, "Error: Failed to allocate new internal node in insertIntoParentS.\n");
+                 fprintf(stderr, "Error: No reserved node for an internal split in insertIntoParentS.\n");
+                 ok = false;
 
                  processed = true;
             } else {
+                statAdd(&cur_lot->stats.s_splits, 1);
 
-                int tmp_k[M]; BPlusTreeNode* tmp_c[M + 1]; int i = 0, j = 0;
+                int tmp_k[S_ORDER]; BPlusTreeNode* tmp_c[S_ORDER + 1]; int i = 0, j = 0;
 
 
                 while (i < p->nkeys && p->data.internal.int_skeys[i] < k) {
@@ -452,13 +1478,13 @@ void insertIntoParentS(BPlusTreeNode* left, int k, BPlusTreeNode* right) {
                 }
 
 
-                int split_idx = M / 2;
+                int split_idx = S_ORDER / 2;
                 int up_key = tmp_k[split_idx];
 
 
                 p->nkeys = split_idx;
                 memset(p->data.internal.int_skeys, 0, sizeof(p->data.internal.int_skeys));
-                memset(p->data.internal.child, 0, sizeof(p->data.internal.child));
+                memset(p->data.internal.s_child, 0, sizeof(p->data.internal.s_child));
                 for(i=0; i < p->nkeys; ++i) {
                     p->data.internal.int_skeys[i] = tmp_k[i];
                     p->data.internal.child[i] = tmp_c[i];
@@ -468,81 +1494,76 @@ void insertIntoParentS(BPlusTreeNode* left, int k, BPlusTreeNode* right) {
                 if(p->data.internal.child[p->nkeys]) p->data.internal.child[p->nkeys]->parent = p;
 
 
-                new_node->nkeys = M - 1 - p->nkeys;
+                new_node->nkeys = S_ORDER - 1 - p->nkeys;
                 new_node->parent = p->parent;
-                memset(new_node->data.internal.int_skeys, 0, sizeof(new_node->data.internal.int_skeys));
-                memset(new_node->data.internal.child, 0, sizeof(new_node->data.internal.child));
                 for(i=0, j=split_idx + 1; i < new_node->nkeys; ++i, ++j) {
                     new_node->data.internal.int_skeys[i] = tmp_k[j];
                     new_node->data.internal.child[i] = tmp_c[j];
                     if(new_node->data.internal.child[i]) new_node->data.internal.child[i]->parent = new_node;
                 }
-                new_node->data.internal.child[new_node->nkeys] = tmp_c[M];
+                new_node->data.internal.child[new_node->nkeys] = tmp_c[S_ORDER];
                 if(new_node->data.internal.child[new_node->nkeys]) new_node->data.internal.child[new_node->nkeys]->parent = new_node;
 
 
-                for(i = p->nkeys + 1; i <= M; ++i) p->data.internal.child[i] = NULL;
-                for(i = new_node->nkeys + 1; i <= M; ++i) new_node->data.internal.child[i] = NULL;
-
-
-                insertIntoParentS(p, up_key, new_node);
+                ok = insertIntoParentS(p, up_key, new_node, spare, nspare);
             }
         }
      }
-
+    return ok;
 }
 
 
-void insertSpace(ParkingSpace s) {
-    bool proceed = true;
+// Returns false if the space could not be linked into the tree.
+bool insertSpace(ParkingSpace s) {
+    bool proceed = true, ok = true;
 
-    if (s_root == NULL) {
-        s_root = createNode(true);
-        if (s_root) {
-            s_root->data.leaf.leaf_s[0] = s;
-            s_root->nkeys = 1;
+    if (cur_lot->s_root == NULL) {
+        cur_lot->s_root = createNode(&cur_lot->s_pool, true);
+        if (cur_lot->s_root) {
+            cur_lot->s_root->data.leaf.leaf_s[0] = s;
+            cur_lot->s_root->nkeys = 1;
         } else {
             fprintf(stderr, "Error: Failed to create root node for spaces.\n");
+            ok = false;
         }
         proceed = false;
     }
 
     BPlusTreeNode* l_node = NULL;
     if (proceed) {
-        l_node = findLeafNodeS(s_root, s.id);
+        l_node = findLeafNodeS(cur_lot->s_root, s.id);
          if (!l_node) {
             fprintf(stderr, "Err: Cannot find leaf for space %d\n", s.id);
-            proceed = false;
+            proceed = ok = false;
         }
     }
 
-     bool found = false;
      if (proceed) {
-         int i = 0;
-         while (i < l_node->nkeys && !found) {
-             if (l_node->data.leaf.leaf_s[i].id == s.id) {
-                 l_node->data.leaf.leaf_s[i] = s;
-                 found = true;
-                  }
-             i++;
-         }
-         if(found) {
+         int i = searchLeafS(l_node, s.id);
+         if (i < l_node->nkeys && l_node->data.leaf.leaf_s[i].id == s.id) {
+             l_node->data.leaf.leaf_s[i] = s;
              proceed = false;
          }
      }
 
     if (proceed) {
-		if (l_node->nkeys < M - 1) {
+		if (l_node->nkeys < S_ORDER - 1) {
             insertIntoLeafS(l_node, s);
         } else {
-            BPlusTreeNode* new_l = createNode(true);
-             if (!new_l) {
-                 fprintf(stderr, "Error: Failed to allocate new leaf node in insertSpace.\n");
-                 proceed = false;
+            BPlusTreeNode *spare[SPLIT_MAX_NODES];
+            int nspare = 0;
+            BPlusTreeNode* new_l = NULL;
+             if (reserveSplit(&cur_lot->s_pool, l_node, S_ORDER, spare, &nspare)) {
+                 new_l = takeSpare(spare, &nspare);
+                 new_l->leaf_flag = true;
+             } else {
+                 fprintf(stderr, "Error: Failed to allocate nodes to split for space %d.\n", s.id);
+                 proceed = ok = false;
              }
 
              if (proceed) {
-                ParkingSpace tmp_s[M];
+                statAdd(&cur_lot->stats.s_splits, 1);
+                ParkingSpace tmp_s[S_ORDER];
                 int i = 0, j = 0;
                 while (i < l_node->nkeys && l_node->data.leaf.leaf_s[i].id < s.id) {
                     tmp_s[j++] = l_node->data.leaf.leaf_s[i++];
@@ -552,13 +1573,12 @@ void insertSpace(ParkingSpace s) {
                     tmp_s[j++] = l_node->data.leaf.leaf_s[i++];
                 }
 
-                int split_pt = (int)ceil((double)M / 2.0);
+                int split_pt = (int)ceil((double)S_ORDER / 2.0);
                 l_node->nkeys = split_pt;
                 memset(l_node->data.leaf.leaf_s, 0, sizeof(l_node->data.leaf.leaf_s));
                 for (i = 0; i < l_node->nkeys; i++) { l_node->data.leaf.leaf_s[i] = tmp_s[i]; }
 
-                new_l->nkeys = M - split_pt;
-                memset(new_l->data.leaf.leaf_s, 0, sizeof(new_l->data.leaf.leaf_s));
+                new_l->nkeys = S_ORDER - split_pt;
                 for (i = 0, j = split_pt; i < new_l->nkeys; i++, j++) { new_l->data.leaf.leaf_s[i] = tmp_s[j]; }
 
                 new_l->data.leaf.next = l_node->data.leaf.next;
@@ -567,29 +1587,37 @@ void insertSpace(ParkingSpace s) {
                 new_l->data.leaf.prev = l_node;
                 new_l->parent = l_node->parent;
 
-                insertIntoParentS(l_node, new_l->data.leaf.leaf_s[0].id, new_l);
+                ok = insertIntoParentS(l_node, new_l->data.leaf.leaf_s[0].id, new_l, spare, &nspare);
+                releaseSpare(&cur_lot->s_pool, spare, &nspare);
             }
         }
     }
+    return ok;
+}
 
+// Lookups on the live tree are answered by the plate index; any other root is searched.
+VHandle findVehicleHandle(BPlusTreeNode *node, const char *v_num) {
+    VHandle h = VH_NONE;
+    PlateKey code = encodePlate(v_num);
+    int i = 0;
+    BPlusTreeNode* l_node = NULL;
+
+    if (node == cur_lot->v_root) h = pindexFind(&cur_lot->v_index, v_num, code);
+    else l_node = locateV(node, v_num, code, &i);
+
+    if (l_node) {
+        if (leafHoldsV(l_node, i, v_num, code)) {
+            h = l_node->data.leaf.leaf_vh[i];
+        }
+    }
+    return h;
 }
 
 Vehicle* findVehicle(BPlusTreeNode *node, const char *v_num) {
     Vehicle* result = NULL; 
-    BPlusTreeNode* l_node = findLeafNodeV(node, v_num);
+    VHandle h = findVehicleHandle(node, v_num);
 
-    if (l_node) { 
-        bool found = false; 
-        for (int i = 0; i < l_node->nkeys && !found; i++) {
-            if (strcmp(l_node->data.leaf.leaf_v[i].v_num, v_num) == 0) {
-                result = &l_node->data.leaf.leaf_v[i];
-                found = true; 
-                
-            }
-        }
-        
-    }
-    
+    if (h != VH_NONE) result = vstoreGet(h);
 
     return result; // Single return statement
 }
@@ -599,721 +1627,4089 @@ ParkingSpace* findSpace(BPlusTreeNode *node, int s_id) {
     BPlusTreeNode* l_node = findLeafNodeS(node, s_id);
 
     if (l_node) { 
-        bool found = false; 
-        for (int i = 0; i < l_node->nkeys && !found; i++) {
-            if (l_node->data.leaf.leaf_s[i].id == s_id) {
-                result = &l_node->data.leaf.leaf_s[i];
-                found = true;
-                
-            }
+        int i = searchLeafS(l_node, s_id);
+        if (i < l_node->nkeys && l_node->data.leaf.leaf_s[i].id == s_id) {
+            result = &l_node->data.leaf.leaf_s[i];
         }
-        
     }
     
 
     return result; 
 }
 
-int allocateSpace(int membership) {
-    int allocated_space_id = -1;
-	int start, end;
-    if (membership == 2) { start = 1; end = 10; }
-    else if (membership == 1) { start = 11; end = 20; }
-    else { start = 21; end = MAX_SPACES; }
+int tierOfSpace(int s_id) {
+    int t = 2;
+    if (s_id <= GOLD_LAST_SPACE) t = 0;
+    else if (s_id <= PREMIUM_LAST_SPACE) t = 1;
+    return t;
+}
 
-    bool space_found = false;
-    for (int i = start; i <= end && !space_found; i++) {
-        ParkingSpace *sp = findSpace(s_root, i);
-        if (sp && sp->status == 0) {
-            sp->status = 1;
-            printf("Allocated space %d (membership: %d)\n", i, membership);
-            allocated_space_id = i;
-            space_found = true;
+// Flips one space's bit with an atomic read-modify-write, so of two gates racing for
+// the same space only one sees it change. Returns true if this call changed it.
+// A summary bit may be left set for an empty word (the scan skips it) but is never
+// left clear for a word with free spaces: it is re-set if a release raced the clear.
+bool tierSetFree(SpaceTier *t, int s_id, bool is_free) {
+    int bit = s_id - t->first;
+    int w = bit / 64;
+    unsigned long long mask = 1ULL << (bit % 64);
+    unsigned long long sum_mask = 1ULL << (w % 64);
+    bool changed;
+    if (is_free) {
+        changed = !(__atomic_fetch_or(&t->free_bits[w], mask, __ATOMIC_SEQ_CST) & mask);
+        if (changed) {
+            __atomic_fetch_or(&t->summary[w / 64], sum_mask, __ATOMIC_SEQ_CST);
+            __atomic_fetch_add(&t->nfree, 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        unsigned long long old = __atomic_fetch_and(&t->free_bits[w], ~mask, __ATOMIC_SEQ_CST);
+        changed = (old & mask) != 0;
+        if (changed) {
+            if ((old & ~mask) == 0) {
+                __atomic_fetch_and(&t->summary[w / 64], ~sum_mask, __ATOMIC_SEQ_CST);
+                if (__atomic_load_n(&t->free_bits[w], __ATOMIC_SEQ_CST) != 0) {
+                    __atomic_fetch_or(&t->summary[w / 64], sum_mask, __ATOMIC_SEQ_CST);
+                }
+            }
+            __atomic_fetch_sub(&t->nfree, 1, __ATOMIC_RELAXED);
         }
     }
+    return changed;
+}
 
-    if (!space_found) {
-         printf("Err: No available space.\n");
+// Claims the lowest free space id in the tier, or returns -1. Adds the number of
+// summary and bitmap words read to *words.
+int tierTakeFree(SpaceTier *t, int *words) {
+    int s_id = -1;
+    int nsum = (t->nwords + 63) / 64;
+    for (int i = 0; i < nsum && s_id == -1; i++) {
+        unsigned long long sum = __atomic_load_n(&t->summary[i], __ATOMIC_SEQ_CST);
+        (*words)++;
+        while (sum && s_id == -1) {
+            int w = i * 64 + __builtin_ctzll(sum);
+            unsigned long long bits = __atomic_load_n(&t->free_bits[w], __ATOMIC_SEQ_CST);
+            (*words)++;
+            while (bits && s_id == -1) {
+                int cand = t->first + w * 64 + __builtin_ctzll(bits);
+                if (tierSetFree(t, cand, false)) s_id = cand;
+                else bits = __atomic_load_n(&t->free_bits[w], __ATOMIC_SEQ_CST);
+            }
+            sum &= sum - 1;
+        }
     }
+    return s_id;
+}
 
-    return allocated_space_id;
+void freeAllocator() {
+    SpaceAllocator *sa = &cur_lot->s_alloc;
+    for (int t = 0; t < NUM_TIERS; t++) {
+        free(sa->tiers[t].free_bits); sa->tiers[t].free_bits = NULL;
+        free(sa->tiers[t].summary); sa->tiers[t].summary = NULL;
+        free(sa->tiers[t].occupant); sa->tiers[t].occupant = NULL;
+        sa->tiers[t].nwords = 0; sa->tiers[t].nfree = 0; sa->tiers[t].noccupied = 0;
+    }
 }
 
-float calcHours(const char *arr_dt, const char *arr_tm,
-                const char *dep_dt, const char *dep_tm) {
-    struct tm arr = {0}, dep = {0};
-    int ad, am, ay, ah, amin;
-    int dd, dm, dy, dh, dmin;
-    if (!arr_dt || !arr_tm || !dep_dt || !dep_tm ||
-        strlen(arr_dt) == 0 || strlen(arr_tm) == 0 ||
-        strlen(dep_dt) == 0 || strlen(dep_tm) == 0 ||
-        strcmp(arr_dt, "-") == 0 || strcmp(arr_tm, "-") == 0 ||
-        strcmp(dep_dt, "-") == 0 || strcmp(dep_tm, "-") == 0)
-    {
-         return 0.0;
+// Records h as the occupant of s_id (VH_NONE clears it). Only the gate holding the
+// space writes its slot, so a plain exchange keeps the occupied count exact.
+void setOccupant(int s_id, VHandle h) {
+    SpaceTier *tier = &cur_lot->s_alloc.tiers[tierOfSpace(s_id)];
+    if (s_id >= tier->first && s_id <= tier->last && tier->occupant) {
+        VHandle old = __atomic_exchange_n(&tier->occupant[s_id - tier->first], h, __ATOMIC_RELEASE);
+        if (old == VH_NONE && h != VH_NONE) __atomic_fetch_add(&tier->noccupied, 1, __ATOMIC_RELAXED);
+        else if (old != VH_NONE && h == VH_NONE) __atomic_fetch_sub(&tier->noccupied, 1, __ATOMIC_RELAXED);
     }
+}
+
+// Returns the handle of the vehicle parked in s_id, or VH_NONE.
+VHandle spaceOccupant(Lot *lot, int s_id) {
+    VHandle h = VH_NONE;
+    const SpaceTier *tier = &lot->s_alloc.tiers[tierOfSpace(s_id)];
+    if (s_id >= tier->first && s_id <= tier->last && tier->occupant) {
+        h = __atomic_load_n(&tier->occupant[s_id - tier->first], __ATOMIC_ACQUIRE);
+    }
+    return h;
+}
 
-    if (sscanf(arr_dt, "%2d%2d%4d", &ad, &am, &ay) != 3 ||
-        sscanf(arr_tm, "%2d%2d", &ah, &amin) != 2 ||
-        sscanf(dep_dt, "%2d%2d%4d", &dd, &dm, &dy) != 3 ||
-        sscanf(dep_tm, "%2d%2d", &dh, &dmin) != 2) {
-        return 0.0;
+// Rebuilds the tier bitmaps from the space tree and the occupants from one pass over the
+// vehicles; call after spaces and vehicles are loaded.
+void initAllocator() {
+    BPlusTreeNode *curr = cur_lot->s_root;
+    while (curr && !curr->leaf_flag) curr = curr->data.internal.child[0];
+    BPlusTreeNode *last = curr;
+    while (last && last->data.leaf.next) last = last->data.leaf.next;
+    int max_id = (last && last->nkeys > 0) ? last->data.leaf.leaf_s[last->nkeys - 1].id : 0;
+
+    freeAllocator();
+    int bounds[NUM_TIERS][2] = {{1, GOLD_LAST_SPACE}, {GOLD_LAST_SPACE + 1, PREMIUM_LAST_SPACE},
+                                {PREMIUM_LAST_SPACE + 1, max_id > PREMIUM_LAST_SPACE ? max_id : PREMIUM_LAST_SPACE + 1}};
+    for (int t = 0; t < NUM_TIERS; t++) {
+        SpaceTier *tier = &cur_lot->s_alloc.tiers[t];
+        tier->first = bounds[t][0]; tier->last = bounds[t][1];
+        tier->nwords = (tier->last - tier->first + 1 + 63) / 64;
+        tier->free_bits = (unsigned long long *)calloc(tier->nwords, sizeof(unsigned long long));
+        tier->summary = (unsigned long long *)calloc((tier->nwords + 63) / 64, sizeof(unsigned long long));
+        tier->occupant = (VHandle *)calloc((size_t)(tier->last - tier->first + 1), sizeof(VHandle));
+        if (!tier->free_bits || !tier->summary || !tier->occupant) perror("Failed to allocate space bitmap");
     }
-    arr.tm_mday = ad; arr.tm_mon = am - 1; arr.tm_year = ay - 1900;
-    arr.tm_hour = ah; arr.tm_min = amin; arr.tm_isdst = -1;
-    dep.tm_mday = dd; dep.tm_mon = dm - 1; dep.tm_year = dy - 1900;
-    dep.tm_hour = dh; dep.tm_min = dmin; dep.tm_isdst = -1;
 
+    for (; curr; curr = curr->data.leaf.next) {
+        for (int i = 0; i < curr->nkeys; i++) {
+            ParkingSpace *sp = &curr->data.leaf.leaf_s[i];
+            SpaceTier *tier = &cur_lot->s_alloc.tiers[tierOfSpace(sp->id)];
+            if (sp->status == 0 && sp->id >= tier->first && sp->id <= tier->last && tier->free_bits) {
+                tierSetFree(tier, sp->id, true);
+            }
+        }
+    }
 
-    time_t t_arr = mktime(&arr);
-    time_t t_dep = mktime(&dep);
+    BPlusTreeNode *vleaf = cur_lot->v_root;
+    while (vleaf && !vleaf->leaf_flag) vleaf = vleaf->data.internal.child[0];
+    for (; vleaf; vleaf = vleaf->data.leaf.next) {
+        for (int i = 0; i < vleaf->nkeys; i++) {
+            VHandle h = vleaf->data.leaf.leaf_vh[i];
+            Vehicle *v = vstoreGet(h);
+            if (isParked(v)) setOccupant(v->space_id, h);
+        }
+    }
+}
 
-    if (t_arr == (time_t)-1 || t_dep == (time_t)-1) {
-        return 0.0;
+// Returns a freed space to its tier's bitmap.
+void releaseSpace(int s_id) {
+    SpaceTier *tier = &cur_lot->s_alloc.tiers[tierOfSpace(s_id)];
+    if (s_id >= tier->first && s_id <= tier->last && tier->free_bits) {
+        tierSetFree(tier, s_id, true);
     }
-    if (t_dep < t_arr) {
+}
 
-         return 0.0;
+int allocateSpace(int membership) {
+    int allocated_space_id = -1;
+    int t = (membership == 2) ? 0 : (membership == 1) ? 1 : 2;
+    int last_t = (cur_lot->s_alloc.overflow == OVERFLOW_DOWN) ? NUM_TIERS - 1 : t;
+
+    int words = 0;
+    for (; t <= last_t && allocated_space_id == -1; t++) {
+        SpaceTier *tier = &cur_lot->s_alloc.tiers[t];
+        int s_id = tier->free_bits ? tierTakeFree(tier, &words) : -1;
+        if (s_id != -1) {
+            ParkingSpace *sp = findSpace(cur_lot->s_root, s_id);
+            if (sp) sp->status = 1;
+            gateLog("Allocated space %d (membership: %d)\n", s_id, membership);
+            allocated_space_id = s_id;
+        }
     }
 
+    if (allocated_space_id == -1) {
+         gateLog("Err: No available space.\n");
+    }
+    statAdd(&cur_lot->stats.allocs, 1);
+    statAdd(&cur_lot->stats.alloc_words, (unsigned long long)words);
 
-    double diff_sec = difftime(t_dep, t_arr);
-    return (float)(diff_sec / 3600.0);
+    return allocated_space_id;
 }
 
-float calcPay(float hrs, int membership) {
-     if (hrs < 0) hrs = 0;
-    float rate;
-    float discount = 1.0;
-
-    if (hrs <= 3.0) {
-        rate = 100.0;
-    } else {
-         float extra_hrs = hrs - 3.0;
-         rate = 100.0 + extra_hrs * 50.0;
+// Takes a specific free space (journal replay); returns s_id, or -1 if it is not free.
+int claimSpace(int s_id) {
+    int claimed = -1;
+    SpaceTier *tier = &cur_lot->s_alloc.tiers[tierOfSpace(s_id)];
+    if (s_id >= tier->first && s_id <= tier->last && tier->free_bits) {
+        if (tierSetFree(tier, s_id, false)) {
+            ParkingSpace *sp = findSpace(cur_lot->s_root, s_id);
+            if (sp) sp->status = 1;
+            claimed = s_id;
+        }
     }
+    return claimed;
+}
 
-    if (membership == 1) discount = 0.9; // Premium
-    else if (membership == 2) discount = 0.8; // Gold
+// Gives back a space taken by allocateSpace or claimSpace for an entry that failed.
+void unclaimSpace(int s_id) {
+    ParkingSpace *sp = findSpace(cur_lot->s_root, s_id);
+    if (sp) sp->status = 0;
+    releaseSpace(s_id);
+}
 
-    return rate * discount;
+// Cursor over the leaf chain; yields records in key order without copying them.
+typedef struct LeafIter {
+    BPlusTreeNode *leaf;
+    int idx;
+} LeafIter;
+
+LeafIter iterBegin(BPlusTreeNode *node) {
+    LeafIter it = { NULL, 0 };
+    while (node && !node->leaf_flag) node = node->data.internal.child[0];
+    it.leaf = node;
+    return it;
 }
 
-void checkMembership(Vehicle *v) {
-    if (v) {
-        int new_mem = 0;
-        if (v->total_hrs >= 200.0) new_mem = 2; // Gold
-        else if (v->total_hrs >= 100.0) new_mem = 1; // Premium
+bool iterAdvance(LeafIter *it) {
+    while (it->leaf && it->idx >= it->leaf->nkeys) {
+        it->leaf = it->leaf->data.leaf.next;
+        it->idx = 0;
+    }
+    return it->leaf != NULL;
+}
 
-        if (new_mem > v->membership) {
-             printf("Membership Upgraded! V# %s is now %s (%.2f hrs).\n",
-                   v->v_num, (new_mem == 2 ? "Gold" : "Premium"), v->total_hrs);
-            v->membership = new_mem;
+Vehicle *iterNextV(LeafIter *it) {
+    Vehicle *v = NULL;
+    if (iterAdvance(it)) {
+        v = vstoreGet(it->leaf->data.leaf.leaf_vh[it->idx++]);
+    }
+    return v;
+}
+
+// Positions an iterator at the first plate >= v_num with one descent.
+LeafIter iterSeekV(BPlusTreeNode *root, const char *v_num) {
+    LeafIter it = { NULL, 0 };
+    it.leaf = locateV(root, v_num, encodePlate(v_num), &it.idx);
+    return it;
+}
+
+typedef bool (*VehicleVisitor)(Vehicle *v, void *arg); // Returns false to stop the scan
+
+// Visits vehicles with lo <= plate <= hi in plate order: one descent, then the leaf
+// chain up to the first key past hi, so O(log n + k). Returns the number visited.
+long scanVehicleRange(BPlusTreeNode *root, const char *lo, const char *hi, VehicleVisitor fn, void *arg) {
+    long n = 0;
+    PlateKey hi_code = encodePlate(hi);
+    bool more = strcmp(lo, hi) <= 0;
+    LeafIter it = iterSeekV(root, lo);
+    while (more && iterAdvance(&it)) {
+        const BPlusTreeNode *l = it.leaf;
+        if (compareVKey(l->data.leaf.leaf_vkeys[it.idx], l->data.leaf.leaf_vh[it.idx], hi_code, hi) > 0) {
+            more = false;
+        } else {
+            n++;
+            more = fn(iterNextV(&it), arg);
         }
     }
+    return n;
+}
 
+// Visits vehicles whose plate starts with prefix, in plate order. They are contiguous
+// in key order starting at the prefix itself.
+long scanVehiclePrefix(BPlusTreeNode *root, const char *prefix, VehicleVisitor fn, void *arg) {
+    long n = 0;
+    size_t len = strlen(prefix);
+    bool more = true;
+    LeafIter it = iterSeekV(root, prefix);
+    Vehicle *v;
+    while (more && (v = iterNextV(&it)) != NULL) {
+        if (strncmp(v->v_num, prefix, len) != 0) {
+            more = false;
+        } else {
+            n++;
+            more = fn(v, arg);
+        }
+    }
+    return n;
+}
 
+ParkingSpace *iterNextS(LeafIter *it) {
+    ParkingSpace *sp = NULL;
+    if (iterAdvance(it)) {
+        sp = &it->leaf->data.leaf.leaf_s[it->idx++];
+    }
+    return sp;
 }
 
-void loadSpaces() {
-    printf("Init parking spaces...\n");
-    FILE *fp = fopen("parking-lot-data.txt", "r");
-    int loaded_count = 0;
-    bool loaded_ids[MAX_SPACES + 1] = {false};
+// True if a sorts ahead of b.
+bool rankBefore(const Ranking *r, int a, int b) {
+    bool before;
+    float ka = r->nodes[a].key, kb = r->nodes[b].key;
+    int c = r->by_owner ? strcasecmp(vstoreGet(a)->owner, vstoreGet(b)->owner) : 0;
+    if (c != 0) before = c < 0;
+    else if (ka != kb) before = ka > kb;
+    else if (r->vehicles) before = strcmp(vstoreGet(a)->v_num, vstoreGet(b)->v_num) < 0;
+    else before = a < b;
+    return before;
+}
 
-    if (fp) {
+int rankSize(const Ranking *r, int t) {
+    return t ? r->nodes[t].size : 0;
+}
 
-        int s_id, s_stat; float s_rev, s_hrs; char line[100];
+void rankFix(Ranking *r, int t) {
+    r->nodes[t].size = 1 + rankSize(r, r->nodes[t].left) + rankSize(r, r->nodes[t].right);
+}
 
-        while (fgets(line, sizeof(line), fp)) {
+// Splits t into the nodes ahead of id and the rest.
+void rankSplit(Ranking *r, int t, int id, int *lo, int *hi) {
+    if (!t) {
+        *lo = *hi = 0;
+    } else if (rankBefore(r, t, id)) {
+        rankSplit(r, r->nodes[t].right, id, &r->nodes[t].right, hi);
+        rankFix(r, t);
+        *lo = t;
+    } else {
+        rankSplit(r, r->nodes[t].left, id, lo, &r->nodes[t].left);
+        rankFix(r, t);
+        *hi = t;
+    }
+}
 
-            if (line[0] != '\n' && line[0] != '#') {
-                if (sscanf(line, "%d %d %f %f", &s_id, &s_stat, &s_hrs, &s_rev) == 4) {
-                    if (s_id > 0 && s_id <= MAX_SPACES) {
-                        ParkingSpace s = {s_id, s_stat, s_rev, s_hrs};
-                        insertSpace(s);
-                        loaded_ids[s_id] = true;
-                        loaded_count++;
-                    }
-                }
-            }
-        }
-        fclose(fp);
-        printf("Loaded/Updated %d spaces from file.\n", loaded_count); 
+// Joins two treaps where every node of a sorts ahead of every node of b.
+int rankMerge(Ranking *r, int a, int b) {
+    int t;
+    if (!a || !b) {
+        t = a ? a : b;
+    } else if (r->nodes[a].prio > r->nodes[b].prio) {
+        r->nodes[a].right = rankMerge(r, r->nodes[a].right, b);
+        rankFix(r, a);
+        t = a;
     } else {
-         printf("Info:parking-lot-data.txt not found.\n");
+        r->nodes[b].left = rankMerge(r, a, r->nodes[b].left);
+        rankFix(r, b);
+        t = b;
     }
+    return t;
+}
 
+int rankRemove(Ranking *r, int t, int id) {
+    if (t == id) {
+        t = rankMerge(r, r->nodes[t].left, r->nodes[t].right);
+    } else if (t) {
+        if (rankBefore(r, id, t)) r->nodes[t].left = rankRemove(r, r->nodes[t].left, id);
+        else r->nodes[t].right = rankRemove(r, r->nodes[t].right, id);
+        rankFix(r, t);
+    }
+    return t;
+}
 
+bool rankReserve(Ranking *r, int id) {
+    int old_cap = r->cap;
+    bool ok = growBuffer((void **)&r->nodes, &r->cap, id, sizeof(RankNode));
+    if (ok && r->cap > old_cap) {
+        memset(r->nodes + old_cap, 0, (size_t)(r->cap - old_cap) * sizeof(RankNode));
+    }
+    return ok;
 }
 
-void loadVehicles() {
-    FILE *fp = fopen("complete-vehicle-database-100.txt", "r");
-    if (!fp) {
-        printf("Info: complete-vehicle-database-100.txt not found.\n"); 
+// Inserts id with the given key, or moves it if already ranked.
+void rankSet(Ranking *r, int id, float key) {
+    if (rankReserve(r, id)) {
+        RankNode *n = &r->nodes[id];
+        if (n->linked) r->root = rankRemove(r, r->root, id);
+        r->prio_state ^= r->prio_state << 13; r->prio_state ^= r->prio_state >> 17; r->prio_state ^= r->prio_state << 5;
+        n->key = key; n->left = n->right = 0; n->size = 1;
+        n->prio = r->prio_state; n->linked = true;
+        int lo, hi;
+        rankSplit(r, r->root, id, &lo, &hi);
+        r->root = rankMerge(r, rankMerge(r, lo, id), hi);
+    }
+}
 
-    } else {
-        printf("Loading vehicles...\n");
-        char line[256]; int count = 0; int skipped = 0;
-
-        while (fgets(line, sizeof(line), fp)) {
-           if (line[0] != '\n' && line[0] != '#') {
-
-                Vehicle v; memset(&v, 0, sizeof(Vehicle));
-                char vn[20], own[50], ad[11], at[5], dd[11], dt[5];
-                int membership, sid, np; float th, tr;
-
-                int parsed = sscanf(line, "%19s %49[^0-9-]%10s %4s %10s %4s %d %f %d %d %f",
-                                    vn, own, ad, at, dd, dt, &membership, &th, &sid, &np, &tr);
-
-                char *end = own + strlen(own) - 1;
-                while(end > own && isspace((unsigned char)*end)) end--;
-                *(end + 1) = '\0';
-
-                if (parsed == 11) {
-                     if (strlen(vn) > 0) {
-                         strcpy(v.v_num, vn); strcpy(v.owner, own);
-                         strcpy(v.arr_date, (strcmp(ad, "-") == 0 ? "" : ad));
-                         strcpy(v.arr_time, (strcmp(at, "-") == 0 ? "" : at));
-                         strcpy(v.dep_date, (strcmp(dd, "-") == 0 ? "" : dd));
-                         strcpy(v.dep_time, (strcmp(dt, "-") == 0 ? "" : dt));
-                         v.membership = membership; v.total_hrs = th; v.space_id = sid; v.parks = np; v.revenue = tr;
-
-                         insertVehicle(v);
-                         count++;
-                         if (v.space_id > 0 && strlen(v.dep_date) == 0) {
-                             ParkingSpace *sp = findSpace(s_root, v.space_id);
-                             if (sp) {
-                                 if (sp->status == 0) {
-								 	sp->status = 1;
-                                 }
-                             } else {
-                                fprintf(stderr, "Warn: Loaded vehicle %s refers to non-existent space %d.\n", v.v_num, v.space_id);
-                             }
-                         }
-                     } else {
-
-                         skipped++;
+// Balanced treap over sorted entries; priorities fall with depth so the heap order holds.
+int rankBuildRange(Ranking *r, const SortKey *e, int lo, int hi, int depth) {
+    int t = 0;
+    if (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        t = e[mid].id;
+        RankNode *n = &r->nodes[t];
+        n->key = e[mid].key; n->linked = true;
+        n->prio = depth < 32 ? (~0u >> depth) : 0;
+        n->left = rankBuildRange(r, e, lo, mid, depth + 1);
+        n->right = rankBuildRange(r, e, mid + 1, hi, depth + 1);
+        rankFix(r, t);
+    }
+    return t;
+}
 
-                     }
-                } else {
-                   skipped++;
+int compareOwnerKeys(const void *a, const void *b) {
+    return strcasecmp(vstoreGet(((const SortKey *)a)->id)->owner, vstoreGet(((const SortKey *)b)->id)->owner);
+}
 
+// Builds a ranking from its tree with one radix sort (a merge sort for owners); later changes are applied incrementally.
+// Leaves are walked in key order and the sort is stable, so ties stay in plate or id order.
+Ranking *rankEnsure(int which) {
+    Ranking *r = &cur_lot->rankings[which];
+    if (!r->built) {
+        SortKey *e = NULL; int cap = 0, n = 0, max_id = 0;
+        bool ok = true;
+        LeafIter it = iterBegin(r->vehicles ? cur_lot->v_root : cur_lot->s_root);
+        while (ok && iterAdvance(&it)) {
+            ok = growBuffer((void **)&e, &cap, n, sizeof(SortKey));
+            if (ok) {
+                if (r->vehicles) {
+                    VHandle h = it.leaf->data.leaf.leaf_vh[it.idx++];
+                    Vehicle *v = vstoreGet(h);
+                    e[n].id = (int)h;
+                    e[n].key = (which == RANK_V_HRS) ? v->total_hrs : (which == RANK_V_REV) ? v->revenue :
+                               (which == RANK_V_TIER) ? (float)v->membership : 0.0f;
+                } else {
+                    ParkingSpace *sp = &it.leaf->data.leaf.leaf_s[it.idx++];
+                    e[n].id = sp->id;
+                    e[n].key = (which == RANK_S_HRS) ? sp->hrs : sp->revenue;
                 }
+                if (e[n].id > max_id) max_id = e[n].id;
+                n++;
             }
         }
-        if (ferror(fp)) {
-             perror("Err reading vehicle file");
+        if (ok) ok = rankReserve(r, max_id) &&
+                     (r->by_owner ? sortRecords(e, n, sizeof(SortKey), compareOwnerKeys) : sortKeysDesc(e, n));
+        if (ok) {
+            r->root = rankBuildRange(r, e, 0, n, 0);
+            r->built = true;
         }
-        printf("Loaded/Updated %d vehicles.", count);
-        if (skipped > 0) printf(" Skipped %d lines.", skipped);
-        printf("\n");
-        fclose(fp);
+        free(e);
     }
-
+    return r;
 }
 
+void rankVehicleChanged(VHandle h) {
+    Vehicle *v = vstoreGet(h);
+    pthread_mutex_lock(&cur_lot->rank_lock);
+    if (cur_lot->rankings[RANK_V_HRS].built) rankSet(&cur_lot->rankings[RANK_V_HRS], (int)h, v->total_hrs);
+    if (cur_lot->rankings[RANK_V_REV].built) rankSet(&cur_lot->rankings[RANK_V_REV], (int)h, v->revenue);
+    if (cur_lot->rankings[RANK_V_TIER].built) rankSet(&cur_lot->rankings[RANK_V_TIER], (int)h, (float)v->membership);
+    // The owner is read from the record, so the index entry is dropped before the name
+    // changes (rankDrop) and only relinked here
+    Ranking *ro = &cur_lot->rankings[RANK_V_OWNER];
+    if (ro->built && !((int)h < ro->cap && ro->nodes[h].linked)) rankSet(ro, (int)h, 0.0f);
+    pthread_mutex_unlock(&cur_lot->rank_lock);
+}
 
-void vehicleEntry(const char *v_num, const char *owner) {
-    time_t now; struct tm *local_tm;
-    char date_str[11]; char time_str[5];
-    bool success = true;
-
-    time(&now); local_tm = localtime(&now);
-    if (local_tm == NULL) {
-        perror("localtime err");
-
-        strcpy(date_str, "00000000"); strcpy(time_str, "0000");
-        fprintf(stderr, "Warning: Could not get current time for vehicle entry.\n");
+void rankSpaceChanged(const ParkingSpace *sp) {
+    pthread_mutex_lock(&cur_lot->rank_lock);
+    if (cur_lot->rankings[RANK_S_HRS].built) rankSet(&cur_lot->rankings[RANK_S_HRS], sp->id, sp->hrs);
+    if (cur_lot->rankings[RANK_S_REV].built) rankSet(&cur_lot->rankings[RANK_S_REV], sp->id, sp->revenue);
+    pthread_mutex_unlock(&cur_lot->rank_lock);
+}
 
-    } else {
-        strftime(date_str, sizeof(date_str), "%d%m%Y", local_tm);
-        strftime(time_str, sizeof(time_str), "%H%M", local_tm);
+void rankCollect(const Ranking *r, int t, int *out, int *n, int limit) {
+    if (t && *n < limit) {
+        rankCollect(r, r->nodes[t].left, out, n, limit);
+        if (*n < limit) out[(*n)++] = t;
+        rankCollect(r, r->nodes[t].right, out, n, limit);
     }
+}
 
-    Vehicle* ev = findVehicle(v_root, v_num);
+// Ids of the first limit entries (all if limit <= 0), best first; caller frees.
+int *rankTop(int which, int limit, int *cnt) {
+    pthread_mutex_lock(&cur_lot->rank_lock);
+    Ranking *r = rankEnsure(which);
+    int total = rankSize(r, r->root);
+    if (limit <= 0 || limit > total) limit = total;
+    int *ids = (int *)malloc((size_t)(limit > 0 ? limit : 1) * sizeof(int));
+    *cnt = 0;
+    if (ids) rankCollect(r, r->root, ids, cnt, limit);
+    else perror("Failed to allocate leaderboard");
+    pthread_mutex_unlock(&cur_lot->rank_lock);
+    return ids;
+}
 
-    if (ev) {
-        printf("Welcome back, %s (%s)!\n", owner, v_num);
-        if (ev->space_id > 0 && strlen(ev->dep_date) == 0) {
-             printf("Err: Vehicle %s already parked in %d.\n", v_num, ev->space_id);
-             success = false;
+// Appends, in index order, the nodes whose owner equals name (or starts with it when
+// prefix is set), or whose tier equals tier for the membership index.
+void rankCollectMatch(const Ranking *r, int t, const char *name, int tier, bool prefix, int **out, int *n, int *cap) {
+    if (t) {
+        int c;
+        if (r->by_owner) {
+            const char *owner = vstoreGet(t)->owner;
+            c = prefix ? strncasecmp(owner, name, strlen(name)) : strcasecmp(owner, name);
+        } else {
+            c = tier - (int)r->nodes[t].key; // Higher tiers come first
         }
+        if (c >= 0) rankCollectMatch(r, r->nodes[t].left, name, tier, prefix, out, n, cap);
+        if (c == 0 && growBuffer((void **)out, cap, *n, sizeof(int))) (*out)[(*n)++] = t;
+        if (c <= 0) rankCollectMatch(r, r->nodes[t].right, name, tier, prefix, out, n, cap);
+    }
+}
 
-        if (success) {
-            strcpy(ev->owner, owner);
-            strcpy(ev->arr_date, date_str); strcpy(ev->arr_time, time_str);
-            strcpy(ev->dep_date, ""); strcpy(ev->dep_time, "");
-
-            int alloc_sp = allocateSpace(ev->membership);
-            if (alloc_sp == -1) {
-                printf("Sorry %s, no space available for %s.\n", owner, v_num);
+// Handles of vehicles by owner (RANK_V_OWNER) or membership tier (RANK_V_TIER), in
+// plate order within equal keys; O(log n + matches). Caller frees.
+int *rankMatch(int which, const char *name, int tier, bool prefix, int *cnt) {
+    int *ids = NULL, cap = 0;
+    *cnt = 0;
+    pthread_mutex_lock(&cur_lot->rank_lock);
+    Ranking *r = rankEnsure(which);
+    rankCollectMatch(r, r->root, name, tier, prefix, &ids, cnt, &cap);
+    pthread_mutex_unlock(&cur_lot->rank_lock);
+    return ids;
+}
 
-                 strcpy(ev->arr_date, ""); strcpy(ev->arr_time, "");
-                 success = false;
+// 1-based position of id, or 0 if it is not ranked.
+int rankOf(int which, int id) {
+    pthread_mutex_lock(&cur_lot->rank_lock);
+    Ranking *r = rankEnsure(which);
+    int pos = 0;
+    if (id > 0 && id < r->cap && r->nodes[id].linked) {
+        int t = r->root;
+        while (t && t != id) {
+            if (rankBefore(r, id, t)) {
+                t = r->nodes[t].left;
             } else {
-                ev->space_id = alloc_sp;
-                printf("V# %s assigned space %d on %s @ %s.\n", v_num, alloc_sp, date_str, time_str);
+                pos += rankSize(r, r->nodes[t].left) + 1;
+                t = r->nodes[t].right;
             }
         }
+        if (t) pos += rankSize(r, r->nodes[t].left) + 1;
+    }
+    pthread_mutex_unlock(&cur_lot->rank_lock);
+    return pos;
+}
 
-    } else {
-        printf("Registering new vehicle: %s (%s)\n", owner, v_num);
-        Vehicle nv = {0};
-        strcpy(nv.v_num, v_num); strcpy(nv.owner, owner);
-        strcpy(nv.arr_date, date_str); strcpy(nv.arr_time, time_str);
-        nv.membership = 0;
-        int alloc_sp = allocateSpace(nv.membership);
-         if (alloc_sp == -1) {
-            printf("Sorry %s, no space available for new vehicle %s.\n", owner, v_num);
-            success = false;
-        } else {
-            nv.space_id = alloc_sp;
-            insertVehicle(nv); // Add the new vehicle to the tree
-            printf("New V# %s registered, assigned space %d on %s @ %s.\n", v_num, alloc_sp, date_str, time_str);
+int rankCount(int which) {
+    pthread_mutex_lock(&cur_lot->rank_lock);
+    Ranking *r = rankEnsure(which);
+    int n = rankSize(r, r->root);
+    pthread_mutex_unlock(&cur_lot->rank_lock);
+    return n;
+}
+
+void rankDrop(Ranking *r, int id) {
+    pthread_mutex_lock(&cur_lot->rank_lock);
+    if (r->built && id > 0 && id < r->cap && r->nodes[id].linked) {
+        r->root = rankRemove(r, r->root, id);
+        r->nodes[id].linked = false;
+    }
+    pthread_mutex_unlock(&cur_lot->rank_lock);
+}
+
+void freeRankings() {
+    for (int i = 0; i < NUM_RANKINGS; i++) {
+        free(cur_lot->rankings[i].nodes); cur_lot->rankings[i].nodes = NULL;
+        cur_lot->rankings[i].cap = 0; cur_lot->rankings[i].root = 0; cur_lot->rankings[i].built = false;
+    }
+}
+
+// Deletion. Vehicle and space trees differ only in key layout, so one rebalancing routine
+// serves both and these helpers move entries for either kind.
+int minKeys(bool vehicles) {
+    return ((vehicles ? V_ORDER : S_ORDER) - 1) / 2;
+}
+
+void moveLeafEntries(BPlusTreeNode *dst, int di, BPlusTreeNode *src, int si, int n, bool vehicles) {
+    if (n > 0 && vehicles) {
+        memmove(&dst->data.leaf.leaf_vkeys[di], &src->data.leaf.leaf_vkeys[si], n * sizeof(PlateKey));
+        memmove(&dst->data.leaf.leaf_vh[di], &src->data.leaf.leaf_vh[si], n * sizeof(VHandle));
+    } else if (n > 0) {
+        memmove(&dst->data.leaf.leaf_s[di], &src->data.leaf.leaf_s[si], n * sizeof(ParkingSpace));
+    }
+}
+
+void moveInternalKeys(BPlusTreeNode *dst, int di, BPlusTreeNode *src, int si, int n, bool vehicles) {
+    if (n > 0 && vehicles) {
+        memmove(&dst->data.internal.int_vkeys[di], &src->data.internal.int_vkeys[si], n * sizeof(PlateKey));
+    } else if (n > 0) {
+        memmove(&dst->data.internal.int_skeys[di], &src->data.internal.int_skeys[si], n * sizeof(int));
+    }
+}
+
+void moveChildren(BPlusTreeNode *dst, int di, BPlusTreeNode *src, int si, int n) {
+    if (n > 0) {
+        memmove(&dst->data.internal.child[di], &src->data.internal.child[si], n * sizeof(BPlusTreeNode *));
+        for (int i = di; i < di + n; i++) {
+            if (dst->data.internal.child[i]) dst->data.internal.child[i]->parent = dst;
         }
     }
+}
 
+// Separator ki of p becomes the first key of leaf.
+void setKeyFromLeaf(BPlusTreeNode *p, int ki, const BPlusTreeNode *leaf, bool vehicles) {
+    if (vehicles) p->data.internal.int_vkeys[ki] = leaf->data.leaf.leaf_vkeys[0];
+    else p->data.internal.int_skeys[ki] = leaf->data.leaf.leaf_s[0].id;
 }
 
+void borrowFromLeft(BPlusTreeNode *p, int ci, bool vehicles) {
+    BPlusTreeNode *node = p->data.internal.child[ci], *left = p->data.internal.child[ci - 1];
+    if (node->leaf_flag) {
+        moveLeafEntries(node, 1, node, 0, node->nkeys, vehicles);
+        moveLeafEntries(node, 0, left, left->nkeys - 1, 1, vehicles);
+        setKeyFromLeaf(p, ci - 1, node, vehicles);
+    } else {
+        moveInternalKeys(node, 1, node, 0, node->nkeys, vehicles);
+        moveChildren(node, 1, node, 0, node->nkeys + 1);
+        moveInternalKeys(node, 0, p, ci - 1, 1, vehicles);
+        moveChildren(node, 0, left, left->nkeys, 1);
+        moveInternalKeys(p, ci - 1, left, left->nkeys - 1, 1, vehicles);
+        left->data.internal.child[left->nkeys] = NULL;
+    }
+    left->nkeys--; node->nkeys++;
+}
 
-void vehicleExit(const char *v_num) {
-    time_t now; struct tm *local_tm;
-    char dep_date_str[11]; char dep_time_str[5];
-    bool proceed = true;
+void borrowFromRight(BPlusTreeNode *p, int ci, bool vehicles) {
+    BPlusTreeNode *node = p->data.internal.child[ci], *right = p->data.internal.child[ci + 1];
+    if (node->leaf_flag) {
+        moveLeafEntries(node, node->nkeys, right, 0, 1, vehicles);
+        moveLeafEntries(right, 0, right, 1, right->nkeys - 1, vehicles);
+        node->nkeys++; right->nkeys--;
+        setKeyFromLeaf(p, ci, right, vehicles);
+    } else {
+        moveInternalKeys(node, node->nkeys, p, ci, 1, vehicles);
+        moveChildren(node, node->nkeys + 1, right, 0, 1);
+        moveInternalKeys(p, ci, right, 0, 1, vehicles);
+        moveInternalKeys(right, 0, right, 1, right->nkeys - 1, vehicles);
+        moveChildren(right, 0, right, 1, right->nkeys);
+        right->data.internal.child[right->nkeys] = NULL;
+        node->nkeys++; right->nkeys--;
+    }
+}
 
-    time(&now); local_tm = localtime(&now);
-    if (local_tm == NULL) {
-        perror("localtime err");
-        fprintf(stderr, "Err getting time for exit %s.\n", v_num);
-        proceed = false;
+// Folds child li+1 of p into child li and drops their separator from p.
+void mergeChildren(BPlusTreeNode *p, int li, bool vehicles) {
+    BPlusTreeNode *left = p->data.internal.child[li], *right = p->data.internal.child[li + 1];
+    if (left->leaf_flag) {
+        moveLeafEntries(left, left->nkeys, right, 0, right->nkeys, vehicles);
+        left->nkeys += right->nkeys;
+        left->data.leaf.next = right->data.leaf.next;
+        if (right->data.leaf.next) right->data.leaf.next->data.leaf.prev = left;
     } else {
-        strftime(dep_date_str, sizeof(dep_date_str), "%d%m%Y", local_tm);
-        strftime(dep_time_str, sizeof(dep_time_str), "%H%M", local_tm);
+        moveInternalKeys(left, left->nkeys, p, li, 1, vehicles);
+        moveInternalKeys(left, left->nkeys + 1, right, 0, right->nkeys, vehicles);
+        moveChildren(left, left->nkeys + 1, right, 0, right->nkeys + 1);
+        left->nkeys += 1 + right->nkeys;
+    }
+    moveInternalKeys(p, li, p, li + 1, p->nkeys - li - 1, vehicles);
+    moveChildren(p, li + 1, p, li + 2, p->nkeys - li - 1);
+    p->data.internal.child[p->nkeys] = NULL;
+    p->nkeys--;
+    freeNode(treePool(vehicles), right);
+}
+
+// Removes slot pos from a leaf, then restores minimum fill up the tree by borrowing
+// from a sibling or merging with one. An emptied root is replaced by its only child.
+void deleteFromLeaf(BPlusTreeNode **root, BPlusTreeNode *leaf, int pos, bool vehicles) {
+    moveLeafEntries(leaf, pos, leaf, pos + 1, leaf->nkeys - pos - 1, vehicles);
+    leaf->nkeys--;
+
+    BPlusTreeNode *node = leaf;
+    bool done = false;
+    while (!done) {
+        BPlusTreeNode *p = node->parent;
+        if (!p) {
+            if (node->nkeys == 0) {
+                BPlusTreeNode *new_root = node->leaf_flag ? NULL : node->data.internal.child[0];
+                if (new_root) new_root->parent = NULL;
+                *root = new_root;
+                freeNode(treePool(vehicles), node);
+            }
+            done = true;
+        } else if (node->nkeys >= minKeys(vehicles)) {
+            done = true;
+        } else {
+            int ci = 0;
+            while (ci <= p->nkeys && p->data.internal.child[ci] != node) ci++;
+            BPlusTreeNode *left = (ci > 0) ? p->data.internal.child[ci - 1] : NULL;
+            BPlusTreeNode *right = (ci < p->nkeys) ? p->data.internal.child[ci + 1] : NULL;
+            if (left && left->nkeys > minKeys(vehicles)) {
+                borrowFromLeft(p, ci, vehicles);
+                done = true;
+            } else if (right && right->nkeys > minKeys(vehicles)) {
+                borrowFromRight(p, ci, vehicles);
+                done = true;
+            } else {
+                mergeChildren(p, left ? ci - 1 : ci, vehicles);
+                node = p;
+            }
+        }
     }
+}
 
-    Vehicle *v = NULL;
-    if (proceed) {
-        v = findVehicle(v_root, v_num);
-        if (!v) {
-            printf("Err: Vehicle %s not found.\n", v_num);
-            proceed = false;
+// Removes a plate from the tree, the plate index and the leaderboards and frees its store slot.
+bool deleteVehicle(const char *v_num) {
+    bool found = false;
+    PlateKey code = encodePlate(v_num);
+    int i = 0;
+    BPlusTreeNode *leaf = locateV(cur_lot->v_root, v_num, code, &i);
+    if (leaf) {
+        if (leafHoldsV(leaf, i, v_num, code)) {
+            VHandle h = leaf->data.leaf.leaf_vh[i];
+            rankDrop(&cur_lot->rankings[RANK_V_HRS], (int)h);
+            rankDrop(&cur_lot->rankings[RANK_V_REV], (int)h);
+            rankDrop(&cur_lot->rankings[RANK_V_TIER], (int)h);
+            rankDrop(&cur_lot->rankings[RANK_V_OWNER], (int)h);
+            deleteFromLeaf(&cur_lot->v_root, leaf, i, true);
+            pindexRemove(&cur_lot->v_index, v_num, code);
+            vstoreRelease(h);
+            found = true;
         }
     }
+    return found;
+}
 
-    if (proceed) {
-        if (v->space_id <= 0 || strlen(v->dep_date) > 0) {
-            printf("Err: Vehicle %s not parked.\n", v_num);
-            proceed = false; // Corrected: Added proceed = false;
+// Removes a space from the tree, the allocator and the leaderboards.
+bool deleteSpace(int s_id) {
+    bool found = false;
+    BPlusTreeNode *leaf = findLeafNodeS(cur_lot->s_root, s_id);
+    if (leaf) {
+        int i = searchLeafS(leaf, s_id);
+        if (i < leaf->nkeys && leaf->data.leaf.leaf_s[i].id == s_id) {
+            SpaceTier *tier = &cur_lot->s_alloc.tiers[tierOfSpace(s_id)];
+            if (s_id >= tier->first && s_id <= tier->last && tier->free_bits) tierSetFree(tier, s_id, false);
+            rankDrop(&cur_lot->rankings[RANK_S_HRS], s_id);
+            rankDrop(&cur_lot->rankings[RANK_S_REV], s_id);
+            deleteFromLeaf(&cur_lot->s_root, leaf, i, false);
+            found = true;
         }
     }
+    return found;
+}
 
+// Local DDMMYYYY/HHMM strings for one minute.
+typedef struct WallClock {
+    EpochMin minute;
+    char date[11];
+    char time[5];
+} WallClock;
+
+// Formats a stamp in local time. The last result is cached per thread and refreshed only
+// when the minute changes, so a burst of gate events costs one localtime call.
+const WallClock *wallClock(EpochMin m) {
+    static __thread WallClock cache = { -1, "", "" };
+    if (m != cache.minute) {
+        time_t t = (time_t)m * 60;
+        struct tm tmv;
+        cache.minute = m;
+        if (m == STAMP_NONE || !localtime_r(&t, &tmv)) {
+            cache.date[0] = cache.time[0] = '\0';
+        } else {
+            strftime(cache.date, sizeof(cache.date), "%d%m%Y", &tmv);
+            strftime(cache.time, sizeof(cache.time), "%H%M", &tmv);
+        }
+    }
+    return &cache;
+}
 
-    if (proceed) {
-        if (strlen(v->arr_date) == 0 || strlen(v->arr_time) == 0 || strcmp(v->arr_date, "-") == 0 || strcmp(v->arr_time, "-") == 0) {
-             printf("Err: V# %s has bad arrival data (%s %s).\n", v_num, v->arr_date, v->arr_time);
-			 proceed = false;
+// Copies a stamp's date and time strings, "-" when unset (the text file convention).
+void formatStamp(EpochMin m, char *date, char *tm_str) {
+    const WallClock *wc = wallClock(m);
+    strcpy(date, wc->date[0] ? wc->date : "-");
+    strcpy(tm_str, wc->time[0] ? wc->time : "-");
+}
+
+// Value of n decimal digits at p, or -1.
+int readDigits(const char *p, int n) {
+    int val = 0;
+    for (int i = 0; i < n && val >= 0; i++) {
+        val = isdigit((unsigned char)p[i]) ? val * 10 + (p[i] - '0') : -1;
+    }
+    return val;
+}
 
+// Parses local DDMMYYYY and HHMM ("-" for none). mktime runs once per distinct hour per
+// thread; loads see few distinct hours, so this stays off the per-record cost.
+bool parseStamp(const char *date, const char *tm_str, EpochMin *out) {
+    static __thread int cached_key = -1;
+    static __thread time_t cached_hour;
+    bool ok = true;
+    *out = STAMP_NONE;
+    if (strcmp(date, "-") != 0) {
+        bool has_time = strcmp(tm_str, "-") != 0;
+        int d = readDigits(date, 2), m = readDigits(date + 2, 2), y = readDigits(date + 4, 4);
+        int hh = has_time ? readDigits(tm_str, 2) : 0, mm = has_time ? readDigits(tm_str + 2, 2) : 0;
+        ok = strlen(date) == 8 && (!has_time || strlen(tm_str) == 4) &&
+             d >= 1 && d <= 31 && m >= 1 && m <= 12 && y >= 0 && hh >= 0 && hh < 24 && mm >= 0 && mm < 60;
+        if (ok) {
+            int key = ((y * 100 + m) * 100 + d) * 100 + hh;
+            if (key != cached_key) {
+                struct tm t = {0};
+                t.tm_mday = d; t.tm_mon = m - 1; t.tm_year = y - 1900;
+                t.tm_hour = hh; t.tm_isdst = -1;
+                cached_hour = mktime(&t);
+                cached_key = key;
+            }
+            ok = cached_hour != (time_t)-1;
+            if (ok) *out = (EpochMin)(cached_hour / 60 + mm);
         }
     }
+    return ok;
+}
 
-    if (proceed) {
-        int sp_id = v->space_id;
+bool isParked(const Vehicle *v) {
+    return v->space_id > 0 && v->departed == STAMP_NONE;
+}
 
-        float sess_hrs = calcHours(v->arr_date, v->arr_time, dep_date_str, dep_time_str);
-        if (sess_hrs < 0) {
-            printf("Err calculating hours (<0). Check times.\n");
-            proceed = false;
-        }
+float calcHours(EpochMin arrived, EpochMin departed) {
+    float hrs = 0.0f;
+    if (arrived != STAMP_NONE && departed >= arrived) hrs = (float)(departed - arrived) / 60.0f;
+    return hrs;
+}
 
-        if (proceed) {
-            float sess_pay = calcPay(sess_hrs, v->membership);
-		    printf("V# %s exiting space %d on %s @ %s.\n", v_num, sp_id, dep_date_str, dep_time_str);
-		    printf("  Arr: %s %s\n", v->arr_date, v->arr_time);
-		    printf("  Session: %.2f hrs, Pay: %.2f\n", sess_hrs, sess_pay);
+float calcPay(float hrs, int membership) {
+     if (hrs < 0) hrs = 0;
+    float rate;
+    float discount = 1.0;
 
-		    strcpy(v->dep_date, dep_date_str); strcpy(v->dep_time, dep_time_str);
-		    v->total_hrs += sess_hrs; v->revenue += sess_pay; v->parks += 1;
-		    v->space_id = 0;
+    if (hrs <= 3.0) {
+        rate = 100.0;
+    } else {
+         float extra_hrs = hrs - 3.0;
+         rate = 100.0 + extra_hrs * 50.0;
+    }
 
-		    checkMembership(v);
+    if (membership == 1) discount = 0.9; // Premium
+    else if (membership == 2) discount = 0.8; // Gold
 
-		    printf("  Updated Totals: %.2f hrs, %.2f rev, %d parks, membership: %d\n",
-		           v->total_hrs, v->revenue, v->parks, v->membership);
+    return rate * discount;
+}
 
-		    ParkingSpace *sp = findSpace(s_root, sp_id);
-		    if (sp) {
-		        if (sp->status == 0) printf("Warn: Space %d was already free for V# %s exit.\n", sp_id, v_num);
-		        sp->status = 0; sp->revenue += sess_pay; sp->hrs += sess_hrs;
-		         printf("  Space %d freed. Updated Space: %.2f hrs, %.2f rev.\n", sp_id, sp->hrs, sp->revenue);
-		    } else {
-		        fprintf(stderr, "CRITICAL Err: Cannot find space %d to free!\n", sp_id);
-		    }
+void checkMembership(Vehicle *v) {
+    if (v) {
+        int new_mem = 0;
+        if (v->total_hrs >= 200.0) new_mem = 2; // Gold
+        else if (v->total_hrs >= 100.0) new_mem = 1; // Premium
+
+        if (new_mem > v->membership) {
+             gateLog("Membership Upgraded! V# %s is now %s (%.2f hrs).\n",
+                   v->v_num, (new_mem == 2 ? "Gold" : "Premium"), v->total_hrs);
+            v->membership = new_mem;
         }
     }
 
+
 }
 
+// A parsed input line; seq keeps file order so the last duplicate wins after sorting.
+typedef struct LoadRecV {
+    Vehicle v;
+    int seq;
+} LoadRecV;
 
-int compareVByHrs(const void *a, const void *b) {
-    int result = 0;
-    float diff = ((Vehicle *)b)->total_hrs - ((Vehicle *)a)->total_hrs;
-    if (diff > 1e-6) result = 1;
-    else if (diff < -1e-6) result = -1;
-    else result = strcmp(((Vehicle *)a)->v_num, ((Vehicle *)b)->v_num);
+typedef struct LoadRecS {
+    ParkingSpace s;
+    int seq;
+} LoadRecS;
+
+int compareLoadRecV(const void *a, const void *b) {
+    int result = strcmp(((LoadRecV *)a)->v.v_num, ((LoadRecV *)b)->v.v_num);
+    if (result == 0) result = ((LoadRecV *)a)->seq - ((LoadRecV *)b)->seq;
     return result;
 }
-int compareVByRev(const void *a, const void *b) {
-    int result = 0;
-    float diff = ((Vehicle *)b)->revenue - ((Vehicle *)a)->revenue;
-     if (diff > 1e-6) result = 1;
-     else if (diff < -1e-6) result = -1;
-     else result = strcmp(((Vehicle *)a)->v_num, ((Vehicle *)b)->v_num);
-     return result;
-}
-int compareSByHrs(const void *a, const void *b) {
-    int result = 0;
-    float diff = ((ParkingSpace *)b)->hrs - ((ParkingSpace *)a)->hrs;
-     if (diff > 1e-6) result = 1;
-     else if (diff < -1e-6) result = -1;
-     else result = ((ParkingSpace *)a)->id - ((ParkingSpace *)b)->id;
-     return result;
-}
-int compareSByRev(const void *a, const void *b) {
-    int result = 0;
-    float diff = ((ParkingSpace *)b)->revenue - ((ParkingSpace *)a)->revenue;
-     if (diff > 1e-6) result = 1;
-     else if (diff < -1e-6) result = -1;
-     else result = ((ParkingSpace *)a)->id - ((ParkingSpace *)b)->id;
-     return result;
+
+int compareLoadRecS(const void *a, const void *b) {
+    int result = ((LoadRecS *)a)->s.id - ((LoadRecS *)b)->s.id;
+    if (result == 0) result = ((LoadRecS *)a)->seq - ((LoadRecS *)b)->seq;
+    return result;
 }
-int compareSpacesByID(const void *a, const void *b) {
-    return ((ParkingSpace *)a)->id - ((ParkingSpace *)b)->id;
+
+int bulkSlots(int max_slots) {
+    int slots = (int)(max_slots * bulk_fill + 0.5);
+    if (slots < 1) slots = 1;
+    if (slots > max_slots) slots = max_slots;
+    return slots;
 }
 
-void collectVehicles(BPlusTreeNode *node, Vehicle *v_arr, int *cnt) {
-    *cnt = 0;
-    if (node) {
-        BPlusTreeNode *curr = node;
-        while (curr && !curr->leaf_flag) {
-         if (curr->data.internal.child[0] == NULL && curr->nkeys >= 0) { return; }
-        curr = curr->data.internal.child[0];
-    }
-
-        // Check if we successfully reached a leaf node
-        if (curr && curr->leaf_flag) {
-            bool collect_more = true;
-            while (curr != NULL && collect_more) {
-                for (int i = 0; i < curr->nkeys && collect_more; i++) {
-                    if (*cnt < MAX_VEHICLES) {
-                        v_arr[*cnt] = curr->data.leaf.leaf_v[i];
-                        (*cnt)++;
-                    } else {
-               		    fprintf(stderr, "Warn: Exceeded MAX_VEHICLES.\n");
-                        collect_more = false;
+// Stacks internal levels over `level` (count nodes, left to right) and returns the root.
+// Internal nodes below the root get at least the minimum fill whatever --fill says, so
+// deletes always find a sibling to borrow from or merge with.
+BPlusTreeNode *buildUpperLevels(BPlusTreeNode **level, int count, int order, bool vehicle_keys) {
+    int per = bulkSlots(order);
+    bool ok = true;
+    if (per < minKeys(vehicle_keys) + 1) per = minKeys(vehicle_keys) + 1;
+    if (per < 2) per = 2;
+
+    while (count > 1 && ok) {
+        int nparents = count / per; // The remainder is spread over these, up to `order` each
+        if (nparents < (count + order - 1) / order) nparents = (count + order - 1) / order;
+        if (nparents < 1) nparents = 1;
+        int pos = 0;
+        for (int p = 0; p < nparents && ok; p++) {
+            int take = count / nparents + (p < count % nparents ? 1 : 0);
+            BPlusTreeNode *node = createNode(treePool(vehicle_keys), false);
+            if (!node) {
+                fprintf(stderr, "Error: Failed to allocate internal node in bulk load.\n");
+                ok = false;
+            } else {
+                node->nkeys = take - 1;
+                for (int j = 0; j < take; j++) {
+                    BPlusTreeNode *child = level[pos + j];
+                    node->data.internal.child[j] = child;
+                    child->parent = node;
+                    if (j > 0) {
+                        BPlusTreeNode *leaf = child;
+                        while (!leaf->leaf_flag) leaf = leaf->data.internal.child[0];
+                        if (vehicle_keys) node->data.internal.int_vkeys[j - 1] = leaf->data.leaf.leaf_vkeys[0];
+                        else node->data.internal.int_skeys[j - 1] = leaf->data.leaf.leaf_s[0].id;
                     }
                 }
-                if(collect_more) {
-                    curr = curr->data.leaf.next;
-                }
+                level[p] = node;
+                pos += take;
             }
         }
+        count = nparents;
     }
-
+    return (ok && count == 1) ? level[0] : NULL;
 }
 
-
-void collectSpaces(BPlusTreeNode *node, ParkingSpace *s_arr, int *cnt) {
-     *cnt = 0;
-    if (node) {
-        BPlusTreeNode *curr = node;
-
-        while (curr && !curr->leaf_flag) {
-	        if (curr->data.internal.child[0] == NULL && curr->nkeys >= 0) { return; }
-	        curr = curr->data.internal.child[0];
-    	}
-
-         if (curr && curr->leaf_flag) {
-            bool collect_more = true;
-            while (curr != NULL && collect_more) {
-                for (int i = 0; i < curr->nkeys && collect_more; i++) {
-                    if (*cnt < MAX_SPACES) {
-                        s_arr[*cnt] = curr->data.leaf.leaf_s[i];
-                        (*cnt)++;
-                    } else {
-               		    fprintf(stderr, "Warn: Exceeded MAX_SPACES.\n");
-                        collect_more = false;
-                    }
-                }
-                if(collect_more) {
-                    curr = curr->data.leaf.next;
+// Builds the vehicle tree bottom-up from records sorted by plate with no duplicates.
+BPlusTreeNode *bulkLoadVehicles(const Vehicle *arr, int n) {
+    BPlusTreeNode *root = NULL;
+    int per = bulkSlots(V_ORDER - 1);
+    int nleaves = (n + per - 1) / per;
+    BPlusTreeNode **level = (n > 0) ? (BPlusTreeNode **)malloc(nleaves * sizeof(BPlusTreeNode *)) : NULL;
+
+    if (level) {
+        BPlusTreeNode *prev = NULL;
+        bool ok = pindexReserve(&cur_lot->v_index, cur_lot->v_index.count + (uint32_t)n);
+        int pos = 0;
+        for (int l = 0; l < nleaves && ok; l++) {
+            int take = n / nleaves + (l < n % nleaves ? 1 : 0);
+            BPlusTreeNode *leaf = createNode(&cur_lot->v_pool, true);
+            if (!leaf) {
+                fprintf(stderr, "Error: Failed to allocate leaf in bulk load.\n");
+                ok = false;
+            } else {
+                for (int k = 0; k < take; k++, pos++) {
+                    leaf->data.leaf.leaf_vkeys[k] = encodePlate(arr[pos].v_num);
+                    leaf->data.leaf.leaf_vh[k] = addVehicleRecord(&arr[pos], leaf->data.leaf.leaf_vkeys[k]);
                 }
+                leaf->nkeys = take;
+                leaf->data.leaf.prev = prev;
+                if (prev) prev->data.leaf.next = leaf;
+                prev = leaf;
+                level[l] = leaf;
             }
         }
-
+        if (ok) root = buildUpperLevels(level, nleaves, V_ORDER, true);
+        free(level);
     }
+    return root;
+}
 
+// Builds the space tree bottom-up from spaces sorted by id with no duplicates.
+BPlusTreeNode *bulkLoadSpaces(const ParkingSpace *arr, int n) {
+    BPlusTreeNode *root = NULL;
+    int per = bulkSlots(S_ORDER - 1);
+    int nleaves = (n + per - 1) / per;
+    BPlusTreeNode **level = (n > 0) ? (BPlusTreeNode **)malloc(nleaves * sizeof(BPlusTreeNode *)) : NULL;
+
+    if (level) {
+        BPlusTreeNode *prev = NULL;
+        bool ok = true;
+        int pos = 0;
+        for (int l = 0; l < nleaves && ok; l++) {
+            int take = n / nleaves + (l < n % nleaves ? 1 : 0);
+            BPlusTreeNode *leaf = createNode(&cur_lot->s_pool, true);
+            if (!leaf) {
+                fprintf(stderr, "Error: Failed to allocate leaf in bulk load.\n");
+                ok = false;
+            } else {
+                memcpy(leaf->data.leaf.leaf_s, &arr[pos], take * sizeof(ParkingSpace));
+                pos += take;
+                leaf->nkeys = take;
+                leaf->data.leaf.prev = prev;
+                if (prev) prev->data.leaf.next = leaf;
+                prev = leaf;
+                level[l] = leaf;
+            }
+        }
+        if (ok) root = buildUpperLevels(level, nleaves, S_ORDER, false);
+        free(level);
+    }
+    return root;
 }
 
+// Puts loaded vehicles into the tree: bulk build on an empty tree, plain inserts otherwise.
+void applyLoadedVehicles(LoadRecV *recs, int n) {
+    bool sorted = true;
+    for (int i = 1; i < n && sorted; i++) {
+        sorted = strcmp(recs[i - 1].v.v_num, recs[i].v.v_num) < 0;
+    }
 
-void displayVByHrs(BPlusTreeNode *node) {
-    if (!node) {
-        printf("No vehicles.\n");
-    } else {
-        Vehicle v_arr[MAX_VEHICLES]; int count = 0;
-        collectVehicles(node, v_arr, &count);
-        if (count == 0) {
-            printf("No vehicles collected.\n");
+    if (cur_lot->v_root == NULL && n > 0) {
+        if (!sorted) sortRecords(recs, n, sizeof(LoadRecV), compareLoadRecV);
+        Vehicle *v_arr = (Vehicle *)malloc((size_t)n * sizeof(Vehicle));
+        if (!v_arr) {
+            perror("Failed to allocate bulk load buffer");
         } else {
-            quickSort(v_arr, count, sizeof(Vehicle), compareVByHrs);
-            printf("\n--- Vehicles by Total Hours ---\n");
-            printf("%-15s %-20s %-10s %-10s %-5s %-10s %-8s\n", "V#.","Owner","TotHrs","Revenue","Parks","Membership","SpaceID");
-            printf("--------------------------------------------------------------------------------\n");
-            for (int i = 0; i < count; i++) {
-                printf("%-15s %-20.20s %-10.2f %-10.2f %-5d %-10d %-8s\n", // Adjusted width for membership
-                       v_arr[i].v_num, v_arr[i].owner, v_arr[i].total_hrs, v_arr[i].revenue,
-                       v_arr[i].parks, v_arr[i].membership,
-                       (v_arr[i].space_id > 0 ? (char[4]){(v_arr[i].space_id/100)%10+'0', (v_arr[i].space_id/10)%10+'0', v_arr[i].space_id%10+'0', '\0'} : "N/A")); // Display space ID or N/A
+            int m = 0;
+            for (int i = 0; i < n; i++) {
+                if (i + 1 < n && strcmp(recs[i].v.v_num, recs[i + 1].v.v_num) == 0) continue; // Later line wins
+                v_arr[m++] = recs[i].v;
             }
-             printf("--------------------------------------------------------------------------------\n");
+            cur_lot->v_root = bulkLoadVehicles(v_arr, m);
+            free(v_arr);
         }
+    } else {
+        for (int i = 0; i < n; i++) insertVehicle(recs[i].v);
     }
-}
 
-void displayVByRev(BPlusTreeNode *node) {
-     if (!node) {
-         printf("No vehicles.\n");
-     } else {
-        Vehicle v_arr[MAX_VEHICLES]; int count = 0;
-        collectVehicles(node, v_arr, &count);
-         if (count == 0) {
-             printf("No vehicles collected .\n");
-         } else {
-            quickSort(v_arr, count, sizeof(Vehicle), compareVByRev);
-            printf("\n--- Vehicles by Revenue ---\n");
-            printf("%-15s %-20s %-10s %-10s %-5s %-10s %-8s\n", "V#.","Owner","Revenue","TotHrs","Parks","Membership","SpaceID");
-            printf("--------------------------------------------------------------------------------\n");
-            for (int i = 0; i < count; i++) {
-                  printf("%-15s %-20.20s %-10.2f %-10.2f %-5d %-10d %-8s\n", // Adjusted width for membership
-                       v_arr[i].v_num, v_arr[i].owner, v_arr[i].revenue, v_arr[i].total_hrs,
-                       v_arr[i].parks, v_arr[i].membership,
-                       (v_arr[i].space_id > 0 ? (char[4]){(v_arr[i].space_id/100)%10+'0', (v_arr[i].space_id/10)%10+'0', v_arr[i].space_id%10+'0', '\0'} : "N/A")); // Display space ID or N/A
+    for (int i = 0; i < n; i++) {
+        Vehicle *v = &recs[i].v;
+        if (isParked(v)) {
+            ParkingSpace *sp = findSpace(cur_lot->s_root, v->space_id);
+            if (sp) {
+                if (sp->status == 0) {
+                    sp->status = 1;
+                }
+            } else {
+               fprintf(stderr, "Warn: Loaded vehicle %s refers to non-existent space %d.\n", v->v_num, v->space_id);
             }
-             printf("--------------------------------------------------------------------------------\n");
-         }
-     }
+        }
+    }
 }
 
-void displaySByHrs(BPlusTreeNode *node) {
-    if (!node) {
-         printf("No spaces.\n");
-    } else {
-        ParkingSpace s_arr[MAX_SPACES]; int count = 0;
-        collectSpaces(node, s_arr, &count);
-         if (count == 0) {
-         	printf("No spaces collected.\n");
-         } else {
-            quickSort(s_arr, count, sizeof(ParkingSpace), compareSByHrs);
-            printf("\n--- Spaces by Total Hours ---\n");
-            printf("%-10s %-10s %-10s %-10s\n", "SpaceID", "Status", "Total Hrs", "Revenue");
-            printf("--------------------------------------------\n");
-            for (int i = 0; i < count; i++) {
-                printf("%-10d %-10s %-10.2f %-10.2f\n",
-                       s_arr[i].id, (s_arr[i].status == 1 ? "Occupied" : "Free"),
-                       s_arr[i].hrs, s_arr[i].revenue);
+void applyLoadedSpaces(LoadRecS *recs, int n) {
+    bool sorted = true;
+    for (int i = 1; i < n && sorted; i++) {
+        sorted = recs[i - 1].s.id < recs[i].s.id;
+    }
+
+    if (cur_lot->s_root == NULL && n > 0) {
+        if (!sorted) sortRecords(recs, n, sizeof(LoadRecS), compareLoadRecS);
+        ParkingSpace *s_arr = (ParkingSpace *)malloc((size_t)n * sizeof(ParkingSpace));
+        if (!s_arr) {
+            perror("Failed to allocate bulk load buffer");
+        } else {
+            int m = 0;
+            for (int i = 0; i < n; i++) {
+                if (i + 1 < n && recs[i].s.id == recs[i + 1].s.id) continue;
+                s_arr[m++] = recs[i].s;
             }
-            printf("--------------------------------------------\n");
+            cur_lot->s_root = bulkLoadSpaces(s_arr, m);
+            free(s_arr);
         }
+    } else {
+        for (int i = 0; i < n; i++) insertSpace(recs[i].s);
     }
 }
 
-void displaySByRev(BPlusTreeNode *node) {
-     if (!node) {
-         printf("No spaces.\n");
-     } else {
-        ParkingSpace s_arr[MAX_SPACES]; int count = 0;
-        collectSpaces(node, s_arr, &count);
-         if (count == 0) {
-             printf("No spaces collected.\n");
-         } else {
-            quickSort(s_arr, count, sizeof(ParkingSpace), compareSByRev);
-            printf("\n--- Spaces by Total Revenue ---\n");
-            printf("%-10s %-10s %-10s %-10s\n", "SpaceID", "Status", "Revenue", "Total Hrs");
-            printf("--------------------------------------------\n");
-            for (int i = 0; i < count; i++) {
-                 printf("%-10d %-10s %-10.2f %-10.2f\n",
-                       s_arr[i].id, (s_arr[i].status == 1 ? "Occupied" : "Free"),
-                       s_arr[i].revenue, s_arr[i].hrs);
+typedef struct MappedFile {
+    const char *data;
+    size_t size;
+} MappedFile;
+
+// Maps a whole file read-only; an empty file maps to size 0.
+bool mapFile(const char *fname, MappedFile *mf) {
+    bool ok = false;
+    int fd = open(fname, O_RDONLY);
+    mf->data = NULL; mf->size = 0;
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            if (st.st_size == 0) {
+                ok = true;
+            } else {
+                void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+                    mf->data = (const char *)p; mf->size = (size_t)st.st_size;
+                    ok = true;
+                } else {
+                    perror("Err mapping file");
+                }
             }
-             printf("--------------------------------------------\n");
-         }
-     }
+        }
+        close(fd);
+    }
+    return ok;
 }
 
+void unmapFile(MappedFile *mf) {
+    if (mf->data) munmap((void *)mf->data, mf->size);
+    mf->data = NULL; mf->size = 0;
+}
 
-void clear_input_buf() {
-    int c; while ((c = getchar()) != '\n' && c != EOF);
+void skipSpaces(const char **p, const char *eol) {
+    while (*p < eol && (**p == ' ' || **p == '\t' || **p == '\r')) (*p)++;
 }
 
-void showMenu() {
-    int choice; char v_num[20]; char owner[50];
-    bool keep_running = true;
+// Copies the next whitespace-delimited token; returns its length, or -1 if longer than max_len.
+int readToken(const char **p, const char *eol, char *buf, int max_len) {
+    int len = 0;
+    skipSpaces(p, eol);
+    while (*p < eol && **p != ' ' && **p != '\t' && **p != '\r' && len <= max_len) {
+        if (len < max_len) buf[len] = **p;
+        len++; (*p)++;
+    }
+    if (len > max_len) {
+        len = -1;
+    } else {
+        buf[len] = '\0';
+    }
+    return len;
+}
 
-    while (keep_running) {
-        printf("\n===== Parking System Menu =====\n");
-        printf("1. Vehicle Entry\n");
-        printf("2. Vehicle Exit\n");
-        printf("3. List Vehicles by Hours\n");
-        printf("4. List Vehicles by Revenue\n");
-        printf("5. List Spaces by Hours\n");
-        printf("6. List Spaces by Revenue\n");
-        printf("7. Save and Exit\n");
-        printf("===============================\n");
-        printf("Enter choice: ");
+bool readInt(const char **p, const char *eol, int *out) {
+    bool neg = false; long val = 0; int digits = 0;
+    skipSpaces(p, eol);
+    if (*p < eol && (**p == '-' || **p == '+')) { neg = (**p == '-'); (*p)++; }
+    while (*p < eol && isdigit((unsigned char)**p) && digits < 10) {
+        val = val * 10 + (**p - '0'); digits++; (*p)++;
+    }
+    *out = (int)(neg ? -val : val);
+    return digits > 0 && (*p == eol || !isdigit((unsigned char)**p));
+}
 
-        if (scanf("%d", &choice) != 1) {
-            printf("Invalid input. Enter number.\n");
-            clear_input_buf();
+// Plain decimal only ("5.", "4.5", "18750"), which is all the data files contain.
+bool readFloat(const char **p, const char *eol, float *out) {
+    bool neg = false; double val = 0.0, scale = 1.0; int digits = 0;
+    skipSpaces(p, eol);
+    if (*p < eol && (**p == '-' || **p == '+')) { neg = (**p == '-'); (*p)++; }
+    while (*p < eol && isdigit((unsigned char)**p)) { val = val * 10 + (**p - '0'); digits++; (*p)++; }
+    if (*p < eol && **p == '.') {
+        (*p)++;
+        while (*p < eol && isdigit((unsigned char)**p)) { scale /= 10; val += (**p - '0') * scale; digits++; (*p)++; }
+    }
+    *out = (float)(neg ? -val : val);
+    return digits > 0;
+}
+
+// Parses one vehicle line; returns NULL on success or a description of the problem.
+const char *parseVehicleLine(const char *p, const char *eol, Vehicle *v) {
+    const char *err = NULL;
+    char ad[11], at[5], dd[11], dt[5];
+    memset(v, 0, sizeof(Vehicle));
+
+    int len = readToken(&p, eol, v->v_num, sizeof(v->v_num) - 1);
+    if (len <= 0) err = (len == 0) ? "missing vehicle number" : "vehicle number too long";
+
+    if (!err) {
+        skipSpaces(&p, eol);
+        const char *start = p;
+        while (p < eol && !isdigit((unsigned char)*p) && *p != '-') p++;
+        const char *end = p;
+        while (end > start && isspace((unsigned char)end[-1])) end--;
+        if (end == start) err = "missing owner name";
+        else if (end - start > (long)sizeof(v->owner) - 1) err = "owner name too long";
+        else { memcpy(v->owner, start, end - start); v->owner[end - start] = '\0'; }
+    }
+
+    if (!err && (readToken(&p, eol, ad, 10) <= 0 || readToken(&p, eol, at, 4) <= 0 ||
+                 readToken(&p, eol, dd, 10) <= 0 || readToken(&p, eol, dt, 4) <= 0)) {
+        err = "bad arrival/departure fields";
+    }
+    if (!err && (!parseStamp(ad, at, &v->arrived) || !parseStamp(dd, dt, &v->departed))) {
+        err = "bad arrival/departure date or time";
+    }
+    if (!err) {
+        if (!readInt(&p, eol, &v->membership)) err = "bad membership";
+        else if (!readFloat(&p, eol, &v->total_hrs)) err = "bad total hours";
+        else if (!readInt(&p, eol, &v->space_id)) err = "bad space id";
+        else if (!readInt(&p, eol, &v->parks)) err = "bad park count";
+        else if (!readFloat(&p, eol, &v->revenue)) err = "bad revenue";
+    }
+    return err;
+}
+
+const char *parseSpaceLine(const char *p, const char *eol, ParkingSpace *s) {
+    const char *err = NULL;
+    memset(s, 0, sizeof(ParkingSpace));
+    if (!readInt(&p, eol, &s->id) || !readInt(&p, eol, &s->status) ||
+        !readFloat(&p, eol, &s->hrs) || !readFloat(&p, eol, &s->revenue)) {
+        err = "expected: id status hours revenue";
+    } else if (s->id <= 0) {
+        err = "space id must be positive";
+    }
+    return err;
+}
+
+typedef struct ParseErr {
+    int line; // Relative to the chunk until merged
+    const char *msg;
+} ParseErr;
+
+// One slice of a mapped input file, parsed by its own thread.
+typedef struct ParseChunk {
+    const char *begin, *end;
+    bool vehicles;
+    void *recs; int nrecs, cap;
+    ParseErr *errs; int nerrs, errcap;
+    int nlines;
+} ParseChunk;
+
+void *parseChunkWorker(void *arg) {
+    ParseChunk *c = (ParseChunk *)arg;
+    size_t rec_size = c->vehicles ? sizeof(LoadRecV) : sizeof(LoadRecS);
+    const char *p = c->begin;
+
+    while (p < c->end) {
+        const char *eol = memchr(p, '\n', c->end - p);
+        if (!eol) eol = c->end;
+        c->nlines++;
+
+        if (p < eol && *p != '#' && !(eol - p == 1 && *p == '\r')) {
+            const char *err = NULL;
+            if (!growBuffer(&c->recs, &c->cap, c->nrecs, rec_size)) {
+                err = "out of memory";
+            } else if (c->vehicles) {
+                LoadRecV *r = &((LoadRecV *)c->recs)[c->nrecs];
+                err = parseVehicleLine(p, eol, &r->v);
+            } else {
+                LoadRecS *r = &((LoadRecS *)c->recs)[c->nrecs];
+                err = parseSpaceLine(p, eol, &r->s);
+            }
+
+            if (!err) {
+                c->nrecs++;
+            } else if (growBuffer((void **)&c->errs, &c->errcap, c->nerrs, sizeof(ParseErr))) {
+                c->errs[c->nerrs].line = c->nlines;
+                c->errs[c->nerrs].msg = err;
+                c->nerrs++;
+            }
+        }
+        p = eol + 1;
+    }
+    return NULL;
+}
+
+// Maps fname, parses it on all cores and returns the records in file order (LoadRecV or LoadRecS).
+// Returns the record count, or -1 if the file cannot be opened; *skipped gets the malformed line count.
+int parseFileParallel(const char *fname, bool vehicles, void **out_recs, int *skipped) {
+    int total = -1;
+    MappedFile mf;
+    *out_recs = NULL; *skipped = 0;
+
+    if (mapFile(fname, &mf)) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        int nchunks = (int)(mf.size / PARSE_MIN_CHUNK) + 1;
+        if (ncpu > 0 && nchunks > ncpu) nchunks = (int)ncpu;
+        ParseChunk *chunks = (ParseChunk *)calloc(nchunks, sizeof(ParseChunk));
+        pthread_t *tids = (pthread_t *)calloc(nchunks, sizeof(pthread_t));
+        size_t rec_size = vehicles ? sizeof(LoadRecV) : sizeof(LoadRecS);
+
+        if (!chunks || !tids) {
+            perror("Failed to allocate parse chunks");
         } else {
-            clear_input_buf();
+            const char *pos = mf.data, *file_end = mf.data + mf.size;
+            for (int i = 0; i < nchunks; i++) {
+                const char *end = (i == nchunks - 1) ? file_end : mf.data + mf.size / nchunks * (i + 1);
+                if (end < pos) end = pos;
+                while (end < file_end && end > mf.data && end[-1] != '\n') end++; // Cut at line starts
+                chunks[i].begin = pos; chunks[i].end = end; chunks[i].vehicles = vehicles;
+                pos = end;
+            }
+            for (int i = 1; i < nchunks; i++) {
+                if (pthread_create(&tids[i], NULL, parseChunkWorker, &chunks[i]) != 0) {
+                    parseChunkWorker(&chunks[i]);
+                    tids[i] = 0;
+                }
+            }
+            parseChunkWorker(&chunks[0]);
+            for (int i = 1; i < nchunks; i++) {
+                if (tids[i]) pthread_join(tids[i], NULL);
+            }
 
-            switch (choice) {
-                case 1:
-                    printf("Enter vehicle number: ");
-                    if(scanf("%19s", v_num) != 1) { fprintf(stderr,"Bad v_num input.\n"); clear_input_buf();}
-                    else {
-                        clear_input_buf();
-                        printf("Enter owner name: ");
-                        if(scanf(" %49[^\n]", owner) != 1) { fprintf(stderr,"Bad owner input.\n"); clear_input_buf();}
-                        else {
-                             clear_input_buf();
-                             vehicleEntry(v_num, owner);
+            int nrecs = 0, line_base = 0, reported = 0;
+            for (int i = 0; i < nchunks; i++) nrecs += chunks[i].nrecs;
+            char *merged = (nrecs > 0) ? (char *)malloc((size_t)nrecs * rec_size) : NULL;
+            if (nrecs > 0 && !merged) {
+                perror("Failed to allocate parsed records");
+            } else {
+                total = 0;
+                for (int i = 0; i < nchunks; i++) {
+                    for (int e = 0; e < chunks[i].nerrs; e++, reported++) {
+                        if (reported < MAX_REPORTED_ERRORS) {
+                            fprintf(stderr, "Warn: %s:%d: %s\n", fname, line_base + chunks[i].errs[e].line, chunks[i].errs[e].msg);
                         }
                     }
-                    break;
+                    *skipped += chunks[i].nerrs;
+                    if (chunks[i].nrecs > 0) {
+                        memcpy(merged + (size_t)total * rec_size, chunks[i].recs, (size_t)chunks[i].nrecs * rec_size);
+                    }
+                    total += chunks[i].nrecs;
+                    line_base += chunks[i].nlines;
+                }
+                if (reported > MAX_REPORTED_ERRORS) {
+                    fprintf(stderr, "Warn: %s: %d more malformed lines not shown.\n", fname, reported - MAX_REPORTED_ERRORS);
+                }
+                for (int i = 0; i < total; i++) {
+                    if (vehicles) ((LoadRecV *)merged)[i].seq = i;
+                    else ((LoadRecS *)merged)[i].seq = i;
+                }
+                *out_recs = merged;
+            }
+            for (int i = 0; i < nchunks; i++) {
+                free(chunks[i].recs);
+                free(chunks[i].errs);
+            }
+        }
+        free(chunks);
+        free(tids);
+        unmapFile(&mf);
+    }
+    return total;
+}
 
-                case 2:
-                    printf("Enter vehicle number: ");
-                     if(scanf("%19s", v_num) != 1) { fprintf(stderr,"Bad v_num input.\n"); clear_input_buf();}
-                     else {
-                        clear_input_buf();
-                        vehicleExit(v_num);
-                     }
-                    break;
+void loadSpaces() {
+    printf("Init parking spaces...\n");
+    void *recs = NULL; int skipped = 0;
+    char path[LOT_PATH_MAX];
+    int loaded_count = parseFileParallel(lotFile("parking-lot-data.txt", path), false, &recs, &skipped);
+
+    if (loaded_count >= 0) {
+        applyLoadedSpaces((LoadRecS *)recs, loaded_count);
+        free(recs);
+        printf("Loaded/Updated %d spaces from file.", loaded_count);
+        if (skipped > 0) printf(" Skipped %d lines.", skipped);
+        printf("\n");
+    } else {
+         printf("Info:%s not found.\n", path);
+    }
 
-                case 3: displayVByHrs(v_root); break;
-                case 4: displayVByRev(v_root); break;
-                case 5: displaySByHrs(s_root); break;
-                case 6: displaySByRev(s_root); break;
-                case 7:
-                    saveDataAndFree();
-                    printf("Data saved. Exiting program.\n");
-                    keep_running = false;
-                    break;
 
-                default:
-                    printf("Invalid choice.\n");
+}
+
+void loadVehicles() {
+    void *recs = NULL; int skipped = 0;
+    char path[LOT_PATH_MAX];
+    int count = parseFileParallel(lotFile("complete-vehicle-database-100.txt", path), true, &recs, &skipped);
+
+    if (count < 0) {
+        printf("Info: %s not found.\n", path);
+
+    } else {
+        printf("Loading vehicles...\n");
+        applyLoadedVehicles((LoadRecV *)recs, count);
+        free(recs);
+        printf("Loaded/Updated %d vehicles.", count);
+        if (skipped > 0) printf(" Skipped %d lines.", skipped);
+        printf("\n");
+    }
+
+}
+
+
+void *journalFlusher(void *arg);
+
+// Opens the journal for appending; with a non-zero budget a flusher thread does the writes.
+bool journalOpen(const char *fname) {
+    Journal *jr = &cur_lot->journal;
+    bool ok = false;
+    jr->fd = open(fname, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (jr->fd < 0) {
+        perror("Err opening journal");
+    } else {
+        ok = true;
+        jr->synced_lsn = jr->next_lsn - 1;
+        if (jr->budget_ms > 0) {
+            jr->running = true;
+            if (pthread_create(&jr->flusher, NULL, journalFlusher, jr) != 0) {
+                fprintf(stderr, "Warn: No journal flusher thread; syncing every event.\n");
+                jr->running = false;
+                jr->budget_ms = 0;
             }
+        }
+    }
+    return ok;
+}
 
-             if (keep_running) {
-                 printf("\nPress Enter to continue...");
-                 getchar();
-             }
+bool writeAll(int fd, const char *data, size_t len) {
+    bool ok = true;
+    while (len > 0 && ok) {
+        ssize_t n = write(fd, data, len);
+        if (n > 0) {
+            data += n; len -= (size_t)n;
+        } else if (n < 0 && errno != EINTR) {
+            perror("Err writing journal");
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// True while the journal cannot take records; gates refuse events until a checkpoint
+// covering every lost record clears it.
+bool journalFailed(Journal *jr) {
+    return __atomic_load_n(&jr->failed, __ATOMIC_ACQUIRE);
+}
+
+// Writes and syncs records ending at last_lsn; caller holds io_lock. After a failure
+// the partial tail is cut off, so replay is not stopped by a torn record, and later
+// writes are refused rather than leaving a gap in the log.
+bool journalWrite(Journal *jr, const char *data, size_t len, uint64_t last_lsn) {
+    bool ok = !jr->failed;
+    if (ok) {
+        off_t end = lseek(jr->fd, 0, SEEK_END);
+        if (!writeAll(jr->fd, data, len)) {
+            ok = false;
+        } else if (fdatasync(jr->fd) != 0) {
+            perror("Err syncing journal");
+            ok = false;
+        }
+        if (!ok) {
+            if (end >= 0 && ftruncate(jr->fd, end) != 0) perror("Err cutting journal tail");
+            fprintf(stderr, "Err: Journal write failed; gate events are refused until a checkpoint succeeds.\n");
+            __atomic_store_n(&jr->failed, true, __ATOMIC_RELEASE);
         }
     }
+    if (!ok && last_lsn > jr->lost_lsn) jr->lost_lsn = last_lsn;
+    return ok;
 }
 
+void *journalFlusher(void *arg) {
+    Journal *j = (Journal *)arg;
+    pthread_mutex_lock(&j->lock);
+    while (j->running || j->len > 0) {
+        while (j->running && j->len == 0) pthread_cond_wait(&j->wake, &j->lock);
 
+        // Let more records join the batch until the first one has waited out the budget
+        while (j->running && !j->flush_now && j->len < JOURNAL_BATCH_BYTES &&
+               pthread_cond_timedwait(&j->wake, &j->lock, &j->deadline) != ETIMEDOUT) {
+        }
 
-void freeTreeRecursive(BPlusTreeNode *n) {
-    if (n != NULL) {
-        if (!n->leaf_flag) {
+        if (j->len > 0) {
+            char *batch = j->buf; int batch_len = j->len; uint64_t batch_lsn = j->buf_last_lsn;
+            int batch_cap = j->cap;
+            j->buf = j->spare; j->cap = j->spare_cap; j->len = 0;
+            j->flush_now = false;
+            pthread_mutex_unlock(&j->lock);
+
+            pthread_mutex_lock(&j->io_lock);
+            bool ok = journalWrite(j, batch, batch_len, batch_lsn);
+            pthread_mutex_unlock(&j->io_lock);
+
+            pthread_mutex_lock(&j->lock);
+            j->spare = batch; j->spare_cap = batch_cap;
+            if (ok && batch_lsn > j->synced_lsn) j->synced_lsn = batch_lsn;
+            pthread_cond_broadcast(&j->synced);
+        }
+        j->flush_now = false;
+    }
+    pthread_mutex_unlock(&j->lock);
+    return NULL;
+}
 
-            for (int i = 0; i <= n->nkeys; i++) {
-                if (n->data.internal.child[i] != NULL) {
-                    freeTreeRecursive(n->data.internal.child[i]);
-                    n->data.internal.child[i] = NULL;
+// Appends one event; it is on disk within the latency budget (immediately when the budget is 0).
+// Returns false if the record was not taken; callers then refuse the event.
+bool journalAppend(int type, const char *v_num, const char *owner, time_t ts, int space_id) {
+    Journal *jr = &cur_lot->journal;
+    bool ok = true;
+    if (jr->fd >= 0) {
+        char rec[sizeof(JournalRecHdr) + 20 + 50];
+        JournalRecHdr hdr; memset(&hdr, 0, sizeof(hdr));
+        hdr.type = (uint8_t)type;
+        hdr.plate_len = (uint8_t)strlen(v_num);
+        hdr.owner_len = (uint8_t)(owner ? strlen(owner) : 0);
+        hdr.len = (uint16_t)(sizeof(hdr) + hdr.plate_len + hdr.owner_len);
+        hdr.ts = (int64_t)ts;
+        hdr.space_id = space_id;
+
+        pthread_mutex_lock(&jr->lock);
+        if (journalFailed(jr)) {
+            ok = false; // Refused before queuing, so a recovered journal never writes it
+        } else {
+            hdr.lsn = jr->next_lsn++;
+            memcpy(rec + sizeof(hdr), v_num, hdr.plate_len);
+            if (hdr.owner_len) memcpy(rec + sizeof(hdr) + hdr.plate_len, owner, hdr.owner_len);
+            memcpy(rec, &hdr, sizeof(hdr));
+            hdr.sum = (uint32_t)checksum(CHECKSUM_SEED, rec + sizeof(uint32_t), hdr.len - sizeof(uint32_t));
+            memcpy(rec, &hdr.sum, sizeof(uint32_t));
+
+            if (jr->budget_ms == 0) {
+                pthread_mutex_lock(&jr->io_lock);
+                ok = journalWrite(jr, rec, hdr.len, hdr.lsn);
+                pthread_mutex_unlock(&jr->io_lock);
+                if (ok) jr->synced_lsn = hdr.lsn;
+            } else if (growBuffer((void **)&jr->buf, &jr->cap, jr->len + hdr.len, 1)) {
+                if (jr->len == 0) {
+                    clock_gettime(CLOCK_REALTIME, &jr->deadline);
+                    jr->deadline.tv_nsec += (long)jr->budget_ms * 1000000L;
+                    jr->deadline.tv_sec += jr->deadline.tv_nsec / 1000000000L;
+                    jr->deadline.tv_nsec %= 1000000000L;
                 }
+                memcpy(jr->buf + jr->len, rec, hdr.len);
+                jr->len += hdr.len;
+                jr->buf_last_lsn = hdr.lsn;
+                pthread_cond_signal(&jr->wake);
+            } else {
+                // No room to batch: write the pending records and this one here, in lsn order
+                pthread_mutex_lock(&jr->io_lock);
+                ok = (jr->len == 0 || journalWrite(jr, jr->buf, jr->len, jr->buf_last_lsn)) &&
+                     journalWrite(jr, rec, hdr.len, hdr.lsn);
+                pthread_mutex_unlock(&jr->io_lock);
+                jr->len = 0;
+                if (ok) jr->synced_lsn = hdr.lsn;
+                pthread_cond_broadcast(&jr->synced);
             }
         }
-        free(n);
+        pthread_mutex_unlock(&jr->lock);
     }
+    return ok;
 }
 
+// Blocks until everything appended so far is durable; false if some of it never will be.
+bool journalFlush() {
+    Journal *jr = &cur_lot->journal;
+    bool ok = true;
+    if (jr->fd >= 0 && jr->budget_ms > 0) {
+        pthread_mutex_lock(&jr->lock);
+        uint64_t target = jr->next_lsn - 1;
+        while (jr->synced_lsn < target && jr->running && !journalFailed(jr)) {
+            jr->flush_now = true;
+            pthread_cond_signal(&jr->wake);
+            pthread_cond_wait(&jr->synced, &jr->lock);
+        }
+        ok = jr->synced_lsn >= target;
+        pthread_mutex_unlock(&jr->lock);
+    } else if (jr->fd >= 0) {
+        ok = !journalFailed(jr);
+    }
+    return ok;
+}
 
-void saveVehiclesToFile(BPlusTreeNode *node, const char *fname) {
-    FILE *fp = fopen(fname, "w");
-    if (!fp) {
-         perror("Err open vehicle file for write");
-         fprintf(stderr, "Failed to open file: %s\n", fname);
-    } else {
-        Vehicle v_arr[MAX_VEHICLES]; int count = 0;
-        collectVehicles(node, v_arr, &count);
-
-        printf("Saving %d vehicles to %s...\n", count, fname);
+// Drops every record; only call once a snapshot covering them is durable.
+void journalReset() {
+    Journal *jr = &cur_lot->journal;
+    if (jr->fd >= 0) {
+        journalFlush();
+        pthread_mutex_lock(&jr->io_lock);
+        if (ftruncate(jr->fd, 0) != 0) perror("Err truncating journal");
+        else fsync(jr->fd);
+        __atomic_store_n(&jr->failed, false, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&jr->io_lock);
+    }
+}
 
+// Drops records with lsn <= upto (already in a durable snapshot) while appends continue:
+// the newer tail is copied to a fresh file that atomically replaces the journal.
+void journalTruncateUpTo(const char *fname, uint64_t upto) {
+    Journal *jr = &cur_lot->journal;
+    if (jr->fd >= 0) {
+        journalFlush();
+        pthread_mutex_lock(&jr->io_lock);
+        MappedFile mf;
+        if (mapFile(fname, &mf)) {
+            size_t off = 0;
+            bool found = false;
+            while (!found && off + sizeof(JournalRecHdr) <= mf.size) {
+                JournalRecHdr hdr;
+                memcpy(&hdr, mf.data + off, sizeof(hdr));
+                if (hdr.lsn > upto || hdr.len < sizeof(hdr)) found = true;
+                else off += hdr.len;
+            }
+            if (off > mf.size) off = mf.size;
+
+            char tmp_name[256];
+            snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", fname);
+            int fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+            if (fd < 0) {
+                perror("Err creating journal tail");
+            } else if (!writeAll(fd, mf.data + off, mf.size - off) || fsync(fd) != 0 || rename(tmp_name, fname) != 0) {
+                perror("Err rewriting journal");
+                close(fd);
+                unlink(tmp_name);
+            } else {
+                dup2(fd, jr->fd); // Same descriptor number, now the new file
+                close(fd);
+                if (jr->failed && jr->lost_lsn <= upto) {
+                    __atomic_store_n(&jr->failed, false, __ATOMIC_RELEASE);
+                    printf("Info: Snapshot covers the lost journal records; gates resume.\n");
+                }
+            }
+            unmapFile(&mf);
+        }
+        pthread_mutex_unlock(&jr->io_lock);
+    }
+}
 
-        for (int i = 0; i < count; i++) {
-            fprintf(fp, "%s %s %s %s %s %s %d %.2f %d %d %.2f\n",
-                    v_arr[i].v_num, v_arr[i].owner,
-                    v_arr[i].arr_date[0] ? v_arr[i].arr_date : "-",
-                    v_arr[i].arr_time[0] ? v_arr[i].arr_time : "-",
-                    v_arr[i].dep_date[0] ? v_arr[i].dep_date : "-",
-                    v_arr[i].dep_time[0] ? v_arr[i].dep_time : "-",
-                    v_arr[i].membership,
-                    v_arr[i].total_hrs >= 0 ? v_arr[i].total_hrs : 0.0,
-					v_arr[i].space_id, v_arr[i].parks,
-                    v_arr[i].revenue >= 0 ? v_arr[i].revenue : 0.0);
+void journalClose() {
+    Journal *jr = &cur_lot->journal;
+    if (jr->fd >= 0) {
+        if (jr->budget_ms > 0 && jr->running) {
+            pthread_mutex_lock(&jr->lock);
+            jr->running = false;
+            pthread_cond_signal(&jr->wake);
+            pthread_mutex_unlock(&jr->lock);
+            pthread_join(jr->flusher, NULL);
         }
-        fclose(fp);
-        printf("Vehicle save done.\n");
+        close(jr->fd);
+        jr->fd = -1;
     }
+    free(jr->buf); jr->buf = NULL; jr->len = jr->cap = 0;
+    free(jr->spare); jr->spare = NULL; jr->spare_cap = 0;
 }
 
-void saveSpacesToFile(BPlusTreeNode *node, const char *fname) {
-    FILE *fp = fopen(fname, "w");
-     if (!fp) {
-         perror("Err open space file for write");
-         fprintf(stderr, "Failed to open file: %s\n", fname);
 
-     } else {
-        ParkingSpace s_arr[MAX_SPACES]; int count = 0;
-        collectSpaces(node, s_arr, &count);
-        quickSort(s_arr, count, sizeof(ParkingSpace), compareSpacesByID);
+// Parks v_num at time `now`. forced_space >= 0 re-applies a journaled allocation instead of choosing one.
+bool admitVehicle(const char *v_num, const char *owner, time_t now, int forced_space) {
+    EpochMin now_m = (EpochMin)(now / 60);
+    const WallClock *wc = wallClock(now_m);
+    bool success = true;
+    int alloc_sp = -1;
+
+    VHandle eh = findVehicleHandle(cur_lot->v_root, v_num);
+    Vehicle* ev = (eh != VH_NONE) ? vstoreGet(eh) : NULL;
+
+    if (forced_space < 0 && journalFailed(&cur_lot->journal)) {
+        gateLog("Err: Journal unavailable; entry of %s refused.\n", v_num);
+        success = false;
+    } else if (ev) {
+        gateLog("Welcome back, %s (%s)!\n", owner, v_num);
+        if (isParked(ev)) {
+             gateLog("Err: Vehicle %s already parked in %d.\n", v_num, ev->space_id);
+             success = false;
+        }
 
-        printf("Saving %d spaces to %s...\n", count, fname);
+        if (success) {
+            alloc_sp = (forced_space >= 0) ? claimSpace(forced_space) : allocateSpace(ev->membership);
+            if (alloc_sp == -1) {
+                gateLog("Sorry %s, no space available for %s.\n", owner, v_num);
+                success = false;
+            } else if (!journalAppend(J_ENTRY, v_num, owner, now, alloc_sp)) {
+                gateLog("Err: Journal write failed; entry of %s refused.\n", v_num);
+                unclaimSpace(alloc_sp);
+                success = false;
+            }
+        }
+        if (success) {
+            if (strcmp(ev->owner, owner) != 0) {
+                rankDrop(&cur_lot->rankings[RANK_V_OWNER], (int)eh);
+                strcpy(ev->owner, owner);
+                rankVehicleChanged(eh);
+            }
+            ev->arrived = now_m;
+            ev->departed = STAMP_NONE;
+            ev->space_id = alloc_sp;
+            setOccupant(alloc_sp, eh);
+            gateLog("V# %s assigned space %d on %s @ %s.\n", v_num, alloc_sp, wc->date, wc->time);
+        }
 
-        for (int i = 0; i < count; i++) {
-            fprintf(fp, "%d %d %.2f %.2f\n",
-                    s_arr[i].id, s_arr[i].status,
-                    s_arr[i].hrs >= 0 ? s_arr[i].hrs : 0.0,
-                    s_arr[i].revenue >= 0 ? s_arr[i].revenue : 0.0);
+    } else {
+        gateLog("Registering new vehicle: %s (%s)\n", owner, v_num);
+        Vehicle nv = {0};
+        strcpy(nv.v_num, v_num); strcpy(nv.owner, owner);
+        nv.arrived = now_m;
+        nv.membership = 0;
+        alloc_sp = (forced_space >= 0) ? claimSpace(forced_space) : allocateSpace(nv.membership);
+         if (alloc_sp == -1) {
+            gateLog("Sorry %s, no space available for new vehicle %s.\n", owner, v_num);
+            success = false;
+        } else {
+            nv.space_id = alloc_sp;
+            VHandle nh = insertVehicle(nv); // Adds the new vehicle to the tree, index and rankings
+            if (nh == VH_NONE) {
+                gateLog("Err: Cannot register %s; space %d released.\n", v_num, alloc_sp);
+                unclaimSpace(alloc_sp);
+                success = false;
+            } else if (!journalAppend(J_ENTRY, v_num, owner, now, alloc_sp)) {
+                gateLog("Err: Journal write failed; entry of %s refused.\n", v_num);
+                deleteVehicle(v_num); // New plates hold the exclusive lock, so nobody has seen it yet
+                unclaimSpace(alloc_sp);
+                success = false;
+            } else {
+                setOccupant(alloc_sp, nh);
+                gateLog("New V# %s registered, assigned space %d on %s @ %s.\n", v_num, alloc_sp, wc->date, wc->time);
+            }
         }
-        fclose(fp);
-        printf("Space save done.\n");
     }
+
+    return success;
 }
 
-void saveDataAndFree() {
-    printf("\n--- Saving Data ---\n");
-    saveVehiclesToFile(v_root, "bplus-vehicle-database.txt");
-    saveSpacesToFile(s_root, "bplus-parking-lot-data.txt");
+pthread_mutex_t *plateLock(Lot *lot, const char *v_num) {
+    return &lot->plate_locks[plateHash(encodePlate(v_num), v_num) % PLATE_LOCKS];
+}
 
-    printf("\n--- Freeing Memory ---\n");
-    freeTreeRecursive(v_root); v_root = NULL;
-    printf("Vehicle tree freed.\n");
-    freeTreeRecursive(s_root); s_root = NULL;
-    printf("Space tree freed.\n");
+// Known plates are admitted under the shared lock and their plate stripe, so gates run
+// in parallel; a new plate changes the tree and index and waits for exclusive access.
+bool vehicleEntry(Lot *lot, const char *v_num, const char *owner, time_t now) {
+    bool ok = false, done = false;
+    uint64_t t0 = monoNanos();
+    useLot(lot);
+    pthread_rwlock_rdlock(&lot->state_lock);
+    if (findVehicleHandle(lot->v_root, v_num) != VH_NONE) {
+        pthread_mutex_t *m = plateLock(lot, v_num);
+        pthread_mutex_lock(m);
+        ok = admitVehicle(v_num, owner, now, -1);
+        pthread_mutex_unlock(m);
+        done = true;
+    }
+    pthread_rwlock_unlock(&lot->state_lock);
+
+    if (!done) {
+        pthread_rwlock_wrlock(&lot->state_lock);
+        ok = admitVehicle(v_num, owner, now, -1);
+        pthread_rwlock_unlock(&lot->state_lock);
+    }
+    histRecord(&lot->stats.entry, monoNanos() - t0);
+    return ok;
 }
 
-int main() {
-    printf("--- Init Parking System ---\n");
-    loadSpaces();
-    loadVehicles();
-    printf("--- Init Complete ---\n");
 
-    showMenu();
+bool departVehicle(const char *v_num, time_t now) {
+    EpochMin now_m = (EpochMin)(now / 60);
+    bool proceed = !journalFailed(&cur_lot->journal);
+    if (!proceed) gateLog("Err: Journal unavailable; exit of %s refused.\n", v_num);
+
+    Vehicle *v = NULL;
+    VHandle vh = VH_NONE;
+    if (proceed) {
+        vh = findVehicleHandle(cur_lot->v_root, v_num);
+        if (vh != VH_NONE) v = vstoreGet(vh);
+        if (!v) {
+            gateLog("Err: Vehicle %s not found.\n", v_num);
+            proceed = false;
+        }
+    }
+
+    if (proceed) {
+        if (!isParked(v)) {
+            gateLog("Err: Vehicle %s not parked.\n", v_num);
+            proceed = false; // Corrected: Added proceed = false;
+        }
+    }
+
+
+    if (proceed) {
+        if (v->arrived == STAMP_NONE) {
+             gateLog("Err: V# %s has no arrival time.\n", v_num);
+			 proceed = false;
+
+        }
+    }
+
+    if (proceed) {
+        int sp_id = v->space_id;
+
+        float sess_hrs = calcHours(v->arrived, now_m);
+        if (sess_hrs < 0) {
+            gateLog("Err calculating hours (<0). Check times.\n");
+            proceed = false;
+        }
+
+        // Journaled before anything changes, and before the space is released so a gate that takes it next logs after us
+        if (proceed && !journalAppend(J_EXIT, v_num, NULL, now, sp_id)) {
+            gateLog("Err: Journal write failed; exit of %s refused.\n", v_num);
+            proceed = false;
+        }
+
+        if (proceed) {
+            float sess_pay = calcPay(sess_hrs, v->membership);
+		    const WallClock *wc = wallClock(now_m);
+		    gateLog("V# %s exiting space %d on %s @ %s.\n", v_num, sp_id, wc->date, wc->time);
+		    wc = wallClock(v->arrived);
+		    gateLog("  Arr: %s %s\n", wc->date, wc->time);
+		    gateLog("  Session: %.2f hrs, Pay: %.2f\n", sess_hrs, sess_pay);
+
+		    v->departed = now_m;
+		    v->total_hrs += sess_hrs; v->revenue += sess_pay; v->parks += 1;
+		    v->space_id = 0;
+
+		    checkMembership(v);
+		    rankVehicleChanged(vh);
 
-    printf("Program end.\n");
-    return 0;
+		    gateLog("  Updated Totals: %.2f hrs, %.2f rev, %d parks, membership: %d\n",
+		           v->total_hrs, v->revenue, v->parks, v->membership);
+		    setOccupant(sp_id, VH_NONE);
+		    ParkingSpace *sp = findSpace(cur_lot->s_root, sp_id);
+		    if (sp) {
+		        if (sp->status == 0) gateLog("Warn: Space %d was already free for V# %s exit.\n", sp_id, v_num);
+		        sp->status = 0; sp->revenue += sess_pay; sp->hrs += sess_hrs;
+		        rankSpaceChanged(sp);
+		        gateLog("  Space %d freed. Updated Space: %.2f hrs, %.2f rev.\n", sp_id, sp->hrs, sp->revenue);
+		        releaseSpace(sp_id);
+		    } else {
+		        fprintf(stderr, "CRITICAL Err: Cannot find space %d to free!\n", sp_id);
+		    }
+        }
+    }
+
+    return proceed;
+}
+
+bool vehicleExit(Lot *lot, const char *v_num, time_t now) {
+    uint64_t t0 = monoNanos();
+    useLot(lot);
+    pthread_rwlock_rdlock(&lot->state_lock);
+    pthread_mutex_t *m = plateLock(lot, v_num);
+    pthread_mutex_lock(m);
+    bool ok = departVehicle(v_num, now);
+    pthread_mutex_unlock(m);
+    pthread_rwlock_unlock(&lot->state_lock);
+    histRecord(&lot->stats.exit, monoNanos() - t0);
+    return ok;
+}
+
+void writeVehicleLine(FILE *fp, const Vehicle *v) {
+    char ad[11], at[5], dd[11], dt[5];
+    formatStamp(v->arrived, ad, at);
+    formatStamp(v->departed, dd, dt);
+    fprintf(fp, "%s %s %s %s %s %s %d %.2f %d %d %.2f\n",
+            v->v_num, v->owner, ad, at, dd, dt,
+            v->membership,
+            v->total_hrs >= 0 ? v->total_hrs : 0.0,
+            v->space_id, v->parks,
+            v->revenue >= 0 ? v->revenue : 0.0);
+}
+
+// Latest arrival or departure as a timestamp, or -1 if the record has no usable date.
+time_t lastSeen(const Vehicle *v) {
+    EpochMin m = (v->departed != STAMP_NONE) ? v->departed : v->arrived;
+    return (m != STAMP_NONE) ? (time_t)m * 60 : (time_t)-1;
+}
+
+// Drops a vehicle that is not parked from memory; its record must already be archived.
+bool retireVehicle(const char *v_num) {
+    bool ok = false;
+    Vehicle *v = findVehicle(cur_lot->v_root, v_num);
+    if (!v) {
+        gateLog("Err: Vehicle %s not found.\n", v_num);
+    } else if (isParked(v)) {
+        gateLog("Err: Vehicle %s is parked; not archived.\n", v_num);
+    } else if (!journalAppend(J_ARCHIVE, v_num, NULL, time(NULL), 0)) {
+        gateLog("Err: Journal write failed; vehicle %s kept.\n", v_num);
+    } else {
+        ok = deleteVehicle(v_num);
+    }
+    return ok;
+}
+
+// Takes a free space out of service.
+bool retireSpace(int s_id) {
+    bool ok = false;
+    ParkingSpace *sp = findSpace(cur_lot->s_root, s_id);
+    if (!sp) {
+        gateLog("Err: Space %d not found.\n", s_id);
+    } else if (sp->status == 1) {
+        gateLog("Err: Space %d is occupied.\n", s_id);
+    } else if (!journalAppend(J_DROP_SPACE, "", NULL, time(NULL), s_id)) {
+        gateLog("Err: Journal unavailable; space %d kept.\n", s_id);
+    } else {
+        ok = deleteSpace(s_id);
+    }
+    return ok;
+}
+
+bool removeSpace(Lot *lot, int s_id) {
+    useLot(lot);
+    pthread_rwlock_wrlock(&lot->state_lock);
+    bool ok = retireSpace(s_id);
+    pthread_rwlock_unlock(&lot->state_lock);
+    if (ok) printf("Space %d removed.\n", s_id);
+    return ok;
+}
+
+// Moves vehicles not seen for `days` days to the lot's ARCHIVE_FILE and out of the hot tree.
+// The archive is synced before anything is deleted, so a crash can only duplicate lines.
+int archiveDormantVehicles(Lot *lot, int days, time_t now) {
+    int archived = 0;
+    useLot(lot);
+    pthread_rwlock_wrlock(&lot->state_lock);
+    char (*plates)[20] = NULL; int cap = 0, n = 0;
+    bool ok = true;
+    char path[LOT_PATH_MAX];
+    FILE *fp = journalFailed(&lot->journal) ? NULL : fopen(lotFile(ARCHIVE_FILE, path), "a");
+
+    if (journalFailed(&lot->journal)) {
+        fprintf(stderr, "Err: Journal unavailable; nothing archived.\n");
+    } else if (!fp) {
+        perror("Err open archive file");
+    } else {
+        LeafIter it = iterBegin(lot->v_root);
+        Vehicle *v;
+        while (ok && (v = iterNextV(&it)) != NULL) {
+            time_t seen = lastSeen(v);
+            if (!isParked(v) && seen != -1 && difftime(now, seen) >= days * 86400.0) {
+                ok = growBuffer((void **)&plates, &cap, n, sizeof(plates[0]));
+                if (ok) {
+                    strcpy(plates[n++], v->v_num);
+                    writeVehicleLine(fp, v);
+                }
+            }
+        }
+        ok = ok && !ferror(fp) && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+        if (fclose(fp) != 0) ok = false;
+        if (!ok) {
+            fprintf(stderr, "Err: Failed to write %s; nothing archived.\n", path);
+        } else {
+            for (int i = 0; i < n; i++) {
+                if (retireVehicle(plates[i])) archived++;
+            }
+        }
+    }
+    free(plates);
+    pthread_rwlock_unlock(&lot->state_lock);
+    printf("Archived %d vehicles not seen for %d days to %s.\n", archived, days, path);
+    return archived;
+}
+
+
+int compareSpacesByID(const void *a, const void *b) {
+    return ((ParkingSpace *)a)->id - ((ParkingSpace *)b)->id;
+}
+
+const char *spaceLabel(int space_id, char *buf) {
+    const char *label = "N/A";
+    if (space_id > 0) {
+        sprintf(buf, "%03d", space_id);
+        label = buf;
+    }
+    return label;
+}
+
+void displayVByHrs(BPlusTreeNode *node, int limit) {
+    if (!node) {
+        printf("No vehicles.\n");
+    } else {
+        int count = 0;
+        int *ids = rankTop(RANK_V_HRS, limit, &count);
+        if (count == 0) {
+            printf("No vehicles collected.\n");
+        } else {
+            printf("\n--- Vehicles by Total Hours ---\n");
+            printf("%-15s %-20s %-10s %-10s %-5s %-10s %-8s\n", "V#.","Owner","TotHrs","Revenue","Parks","Membership","SpaceID");
+            printf("--------------------------------------------------------------------------------\n");
+            char sp_buf[12];
+            for (int i = 0; i < count; i++) {
+                Vehicle *v = vstoreGet((VHandle)ids[i]);
+                printf("%-15s %-20.20s %-10.2f %-10.2f %-5d %-10d %-8s\n", // Adjusted width for membership
+                       v->v_num, v->owner, v->total_hrs, v->revenue,
+                       v->parks, v->membership,
+                       spaceLabel(v->space_id, sp_buf)); // Display space ID or N/A
+            }
+             printf("--------------------------------------------------------------------------------\n");
+        }
+        free(ids);
+    }
+}
+
+void displayVByRev(BPlusTreeNode *node, int limit) {
+     if (!node) {
+         printf("No vehicles.\n");
+     } else {
+        int count = 0;
+        int *ids = rankTop(RANK_V_REV, limit, &count);
+         if (count == 0) {
+             printf("No vehicles collected .\n");
+         } else {
+            printf("\n--- Vehicles by Revenue ---\n");
+            printf("%-15s %-20s %-10s %-10s %-5s %-10s %-8s\n", "V#.","Owner","Revenue","TotHrs","Parks","Membership","SpaceID");
+            printf("--------------------------------------------------------------------------------\n");
+            char sp_buf[12];
+            for (int i = 0; i < count; i++) {
+                Vehicle *v = vstoreGet((VHandle)ids[i]);
+                  printf("%-15s %-20.20s %-10.2f %-10.2f %-5d %-10d %-8s\n", // Adjusted width for membership
+                       v->v_num, v->owner, v->revenue, v->total_hrs,
+                       v->parks, v->membership,
+                       spaceLabel(v->space_id, sp_buf)); // Display space ID or N/A
+            }
+             printf("--------------------------------------------------------------------------------\n");
+         }
+         free(ids);
+     }
+}
+
+void displaySByHrs(BPlusTreeNode *node, int limit) {
+    if (!node) {
+         printf("No spaces.\n");
+    } else {
+        int count = 0;
+        int *ids = rankTop(RANK_S_HRS, limit, &count);
+         if (count == 0) {
+         	printf("No spaces collected.\n");
+         } else {
+            printf("\n--- Spaces by Total Hours ---\n");
+            printf("%-10s %-10s %-10s %-10s\n", "SpaceID", "Status", "Total Hrs", "Revenue");
+            printf("--------------------------------------------\n");
+            for (int i = 0; i < count; i++) {
+                ParkingSpace *sp = findSpace(node, ids[i]);
+                if (sp) {
+                    printf("%-10d %-10s %-10.2f %-10.2f\n",
+                           sp->id, (sp->status == 1 ? "Occupied" : "Free"),
+                           sp->hrs, sp->revenue);
+                }
+            }
+            printf("--------------------------------------------\n");
+        }
+        free(ids);
+    }
+}
+
+void displaySByRev(BPlusTreeNode *node, int limit) {
+     if (!node) {
+         printf("No spaces.\n");
+     } else {
+        int count = 0;
+        int *ids = rankTop(RANK_S_REV, limit, &count);
+         if (count == 0) {
+             printf("No spaces collected.\n");
+         } else {
+            printf("\n--- Spaces by Total Revenue ---\n");
+            printf("%-10s %-10s %-10s %-10s\n", "SpaceID", "Status", "Revenue", "Total Hrs");
+            printf("--------------------------------------------\n");
+            for (int i = 0; i < count; i++) {
+                ParkingSpace *sp = findSpace(node, ids[i]);
+                if (sp) {
+                     printf("%-10d %-10s %-10.2f %-10.2f\n",
+                           sp->id, (sp->status == 1 ? "Occupied" : "Free"),
+                           sp->revenue, sp->hrs);
+                }
+            }
+             printf("--------------------------------------------\n");
+         }
+         free(ids);
+     }
+}
+
+void displayVehicleRank(const char *v_num) {
+    VHandle h = findVehicleHandle(cur_lot->v_root, v_num);
+    if (h == VH_NONE) {
+        printf("Err: Vehicle %s not found.\n", v_num);
+    } else {
+        Vehicle *v = vstoreGet(h);
+        int total = rankCount(RANK_V_HRS);
+        printf("V# %s: rank %d of %d by hours (%.2f), rank %d of %d by revenue (%.2f).\n", v_num,
+               rankOf(RANK_V_HRS, (int)h), total, v->total_hrs,
+               rankOf(RANK_V_REV, (int)h), rankCount(RANK_V_REV), v->revenue);
+    }
+}
+
+
+bool printVehicleRow(Vehicle *v, void *arg) {
+    char sp_buf[12];
+    (void)arg;
+    printf("%-15s %-20.20s %-10.2f %-10.2f %-5d %-10d %-8s\n",
+           v->v_num, v->owner, v->total_hrs, v->revenue, v->parks, v->membership, spaceLabel(v->space_id, sp_buf));
+    return true;
+}
+
+// Lists the vehicles with plates in [lo, hi], or starting with lo when hi is NULL.
+void displayVehicleScan(const char *lo, const char *hi) {
+    if (hi) printf("\n--- Vehicles %s to %s ---\n", lo, hi);
+    else printf("\n--- Vehicles %s* ---\n", lo);
+    printf("%-15s %-20s %-10s %-10s %-5s %-10s %-8s\n", "V#.","Owner","TotHrs","Revenue","Parks","Membership","SpaceID");
+    printf("--------------------------------------------------------------------------------\n");
+    long n = hi ? scanVehicleRange(cur_lot->v_root, lo, hi, printVehicleRow, NULL)
+                : scanVehiclePrefix(cur_lot->v_root, lo, printVehicleRow, NULL);
+    printf("--------------------------------------------------------------------------------\n");
+    printf("%ld vehicles.\n", n);
+}
+
+// Lists the vehicles of an owner (a trailing '*' matches a name prefix, case ignored)
+// or, when owner is NULL, the members of a tier, through the secondary indexes.
+void displayVehicleMatches(const char *owner, int tier) {
+    char name[50] = "";
+    bool prefix = false;
+    int count = 0;
+    if (owner) {
+        snprintf(name, sizeof(name), "%s", owner);
+        size_t len = strlen(name);
+        prefix = len > 0 && name[len - 1] == '*';
+        if (prefix) name[len - 1] = '\0';
+        printf("\n--- Vehicles of %s%s ---\n", name, prefix ? "*" : "");
+    } else {
+        printf("\n--- %s Members ---\n", tier == 2 ? "Gold" : tier == 1 ? "Premium" : "General");
+    }
+    int *ids = rankMatch(owner ? RANK_V_OWNER : RANK_V_TIER, name, tier, prefix, &count);
+    printf("%-15s %-20s %-10s %-10s %-5s %-10s %-8s\n", "V#.","Owner","TotHrs","Revenue","Parks","Membership","SpaceID");
+    printf("--------------------------------------------------------------------------------\n");
+    for (int i = 0; i < count; i++) printVehicleRow(vstoreGet((VHandle)ids[i]), NULL);
+    printf("--------------------------------------------------------------------------------\n");
+    printf("%d vehicles.\n", count);
+    free(ids);
+}
+
+// Occupied and free spaces per tier, straight from the allocator counters.
+void displayOccupancy() {
+    const char *names[NUM_TIERS] = {"Gold", "Premium", "General"};
+    int tot_occ = 0, tot_free = 0;
+    printf("\n--- Space Occupancy ---\n");
+    printf("%-10s %-10s %-10s %-10s\n", "Tier", "Occupied", "Free", "Total");
+    printf("------------------------------------------\n");
+    for (int t = 0; t < NUM_TIERS; t++) {
+        const SpaceTier *tier = &cur_lot->s_alloc.tiers[t];
+        int occ = __atomic_load_n(&tier->noccupied, __ATOMIC_RELAXED);
+        int nfree = __atomic_load_n(&tier->nfree, __ATOMIC_RELAXED);
+        printf("%-10s %-10d %-10d %-10d\n", names[t], occ, nfree, occ + nfree);
+        tot_occ += occ; tot_free += nfree;
+    }
+    printf("------------------------------------------\n");
+    printf("%-10s %-10d %-10d %-10d\n", "All", tot_occ, tot_free, tot_occ + tot_free);
+}
+
+void displaySpaceOccupant(int s_id) {
+    ParkingSpace *sp = findSpace(cur_lot->s_root, s_id);
+    VHandle h = spaceOccupant(cur_lot, s_id);
+    if (!sp) {
+        printf("Err: Space %d not found.\n", s_id);
+    } else if (h == VH_NONE) {
+        printf("Space %d is free.\n", s_id);
+    } else {
+        printf("%-15s %-20s %-10s %-10s %-5s %-10s %-8s\n", "V#.","Owner","TotHrs","Revenue","Parks","Membership","SpaceID");
+        printVehicleRow(vstoreGet(h), NULL);
+    }
+}
+
+
+void clear_input_buf() {
+    int c; while ((c = getchar()) != '\n' && c != EOF);
+}
+
+void showMenu() {
+    int choice, num_in; char v_num[20]; char owner[50]; char v_hi[20];
+    bool keep_running = true;
+
+    while (keep_running) {
+        printf("\n===== Parking System Menu =====\n");
+        printf("1. Vehicle Entry\n");
+        printf("2. Vehicle Exit\n");
+        printf("3. List Vehicles by Hours\n");
+        printf("4. List Vehicles by Revenue\n");
+        printf("5. List Spaces by Hours\n");
+        printf("6. List Spaces by Revenue\n");
+        printf("7. Save and Exit\n");
+        printf("8. Checkpoint Now (background)\n");
+        printf("9. Leaderboards (Top N)\n");
+        printf("10. Rank of Vehicle\n");
+        printf("11. Archive Dormant Vehicles\n");
+        printf("12. Remove Parking Space\n");
+        printf("13. Switch Lot (now: %s)\n", cur_lot->name);
+        printf("14. Engine Stats\n");
+        printf("15. Vehicles by Plate Prefix\n");
+        printf("16. Vehicles in Plate Range\n");
+        printf("17. Vehicles by Owner\n");
+        printf("18. Vehicles by Membership\n");
+        printf("19. Space Occupancy\n");
+        printf("20. Vehicle in Space\n");
+        printf("===============================\n");
+        printf("Enter choice: ");
+
+        if (scanf("%d", &choice) != 1) {
+            printf("Invalid input. Enter number.\n");
+            clear_input_buf();
+        } else {
+            clear_input_buf();
+
+            switch (choice) {
+                case 1:
+                    printf("Enter vehicle number: ");
+                    if(scanf("%19s", v_num) != 1) { fprintf(stderr,"Bad v_num input.\n"); clear_input_buf();}
+                    else {
+                        clear_input_buf();
+                        printf("Enter owner name: ");
+                        if(scanf(" %49[^\n]", owner) != 1) { fprintf(stderr,"Bad owner input.\n"); clear_input_buf();}
+                        else {
+                             clear_input_buf();
+                             vehicleEntry(cur_lot, v_num, owner, time(NULL));
+                        }
+                    }
+                    break;
+
+                case 2:
+                    printf("Enter vehicle number: ");
+                     if(scanf("%19s", v_num) != 1) { fprintf(stderr,"Bad v_num input.\n"); clear_input_buf();}
+                     else {
+                        clear_input_buf();
+                        vehicleExit(cur_lot, v_num, time(NULL));
+                     }
+                    break;
+
+                case 3: displayVByHrs(cur_lot->v_root, 0); break;
+                case 4: displayVByRev(cur_lot->v_root, 0); break;
+                case 5: displaySByHrs(cur_lot->s_root, 0); break;
+                case 6: displaySByRev(cur_lot->s_root, 0); break;
+                case 7:
+                    closeAllLots(true);
+                    printf("Data saved. Exiting program.\n");
+                    keep_running = false;
+                    break;
+                case 8: requestCheckpoint(); break;
+                case 9:
+                    printf("Show top how many? ");
+                    if (scanf("%d", &num_in) != 1 || num_in <= 0) { fprintf(stderr,"Bad count input.\n"); clear_input_buf();}
+                    else {
+                        clear_input_buf();
+                        displayVByHrs(cur_lot->v_root, num_in);
+                        displayVByRev(cur_lot->v_root, num_in);
+                        displaySByHrs(cur_lot->s_root, num_in);
+                        displaySByRev(cur_lot->s_root, num_in);
+                    }
+                    break;
+                case 10:
+                    printf("Enter vehicle number: ");
+                    if(scanf("%19s", v_num) != 1) { fprintf(stderr,"Bad v_num input.\n"); clear_input_buf();}
+                    else {
+                        clear_input_buf();
+                        displayVehicleRank(v_num);
+                    }
+                    break;
+                case 11:
+                    printf("Archive vehicles not seen for how many days? ");
+                    if (scanf("%d", &num_in) != 1 || num_in < 0) { fprintf(stderr,"Bad days input.\n"); clear_input_buf();}
+                    else {
+                        clear_input_buf();
+                        archiveDormantVehicles(cur_lot, num_in, time(NULL));
+                    }
+                    break;
+                case 12:
+                    printf("Enter space ID: ");
+                    if (scanf("%d", &num_in) != 1) { fprintf(stderr,"Bad space input.\n"); clear_input_buf();}
+                    else {
+                        clear_input_buf();
+                        removeSpace(cur_lot, num_in);
+                    }
+                    break;
+                case 13:
+                    for (int i = 0; i < nlots; i++) printf("%d. %s (%s)\n", i + 1, lots[i]->name, lots[i]->dir[0] ? lots[i]->dir : ".");
+                    printf("Select lot: ");
+                    if (scanf("%d", &num_in) != 1 || num_in < 1 || num_in > nlots) { fprintf(stderr,"Bad lot input.\n"); clear_input_buf();}
+                    else {
+                        clear_input_buf();
+                        useLot(lots[num_in - 1]);
+                        printf("Now working on lot %s.\n", cur_lot->name);
+                    }
+                    break;
+                case 14: showStats(); break;
+                case 15:
+                    printf("Enter plate prefix: ");
+                    if(scanf("%19s", v_num) != 1) { fprintf(stderr,"Bad prefix input.\n"); clear_input_buf();}
+                    else {
+                        clear_input_buf();
+                        displayVehicleScan(v_num, NULL);
+                    }
+                    break;
+                case 16:
+                    printf("Enter first and last plate: ");
+                    if(scanf("%19s %19s", v_num, v_hi) != 2) { fprintf(stderr,"Bad range input.\n"); clear_input_buf();}
+                    else {
+                        clear_input_buf();
+                        displayVehicleScan(v_num, v_hi);
+                    }
+                    break;
+                case 17:
+                    printf("Enter owner name (end with * to match a prefix): ");
+                    if(scanf(" %49[^\n]", owner) != 1) { fprintf(stderr,"Bad owner input.\n"); clear_input_buf();}
+                    else {
+                        clear_input_buf();
+                        displayVehicleMatches(owner, 0);
+                    }
+                    break;
+                case 18:
+                    printf("Enter membership (0 general, 1 premium, 2 gold): ");
+                    if (scanf("%d", &num_in) != 1 || num_in < 0 || num_in > 2) { fprintf(stderr,"Bad membership input.\n"); clear_input_buf();}
+                    else {
+                        clear_input_buf();
+                        displayVehicleMatches(NULL, num_in);
+                    }
+                    break;
+                case 19: displayOccupancy(); break;
+                case 20:
+                    printf("Enter space ID: ");
+                    if (scanf("%d", &num_in) != 1) { fprintf(stderr,"Bad space input.\n"); clear_input_buf();}
+                    else {
+                        clear_input_buf();
+                        displaySpaceOccupant(num_in);
+                    }
+                    break;
+
+                default:
+                    printf("Invalid choice.\n");
+            }
+
+             if (keep_running) {
+                 printf("\nPress Enter to continue...");
+                 getchar();
+             }
+        }
+    }
+}
+
+
+void saveVehiclesToFile(BPlusTreeNode *node, const char *fname) {
+    FILE *fp = fopen(fname, "w");
+    if (!fp) {
+         perror("Err open vehicle file for write");
+         fprintf(stderr, "Failed to open file: %s\n", fname);
+    } else {
+        LeafIter it = iterBegin(node);
+        Vehicle *v; int count = 0;
+
+        printf("Saving vehicles to %s...\n", fname);
+
+
+        while ((v = iterNextV(&it)) != NULL) {
+            writeVehicleLine(fp, v);
+            count++;
+        }
+        if (ferror(fp)) perror("Err writing vehicle file");
+        fclose(fp);
+        printf("Vehicle save done (%d vehicles).\n", count);
+    }
+}
+
+void saveSpacesToFile(BPlusTreeNode *node, const char *fname) {
+    FILE *fp = fopen(fname, "w");
+     if (!fp) {
+         perror("Err open space file for write");
+         fprintf(stderr, "Failed to open file: %s\n", fname);
+
+     } else {
+        LeafIter it = iterBegin(node); // Leaf chain is already in id order
+        ParkingSpace *sp; int count = 0;
+
+        printf("Saving spaces to %s...\n", fname);
+
+        while ((sp = iterNextS(&it)) != NULL) {
+            fprintf(fp, "%d %d %.2f %.2f\n",
+                    sp->id, sp->status,
+                    sp->hrs >= 0 ? sp->hrs : 0.0,
+                    sp->revenue >= 0 ? sp->revenue : 0.0);
+            count++;
+        }
+        if (ferror(fp)) perror("Err writing space file");
+        fclose(fp);
+        printf("Space save done (%d spaces).\n", count);
+    }
+}
+
+// Binary snapshot: header, then fixed-width Vehicle records in plate order, then ParkingSpace records in id order.
+typedef struct SnapHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vehicle_size;  // Record widths guard against loading a build with a different layout
+    uint32_t space_size;
+    uint32_t reserved;
+    uint64_t last_lsn;      // Newest journal record already reflected in this snapshot
+    uint64_t nvehicles;
+    uint64_t nspaces;
+    uint64_t vehicles_sum;
+    uint64_t spaces_sum;
+    uint64_t header_sum;    // Over every field above
+} SnapHeader;
+
+// Vehicle record of snapshot version 2, which kept timestamps as strings.
+typedef struct VehicleV2 {
+    char v_num[20];
+    char owner[50];
+    char arr_date[11];
+    char arr_time[5];
+    char dep_date[11];
+    char dep_time[5];
+    int  membership;
+    float total_hrs;
+    int space_id;
+    int parks;
+    float revenue;
+} VehicleV2;
+
+// Upgrades version 2 records; returns a heap array the caller frees, or NULL.
+Vehicle *convertVehiclesV2(const VehicleV2 *old, size_t n) {
+    Vehicle *out = (Vehicle *)calloc(n ? n : 1, sizeof(Vehicle));
+    if (!out) {
+        perror("Failed to allocate snapshot conversion buffer");
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            const VehicleV2 *o = &old[i];
+            Vehicle *v = &out[i];
+            strcpy(v->v_num, o->v_num); strcpy(v->owner, o->owner);
+            parseStamp(o->arr_date[0] ? o->arr_date : "-", o->arr_time[0] ? o->arr_time : "-", &v->arrived);
+            parseStamp(o->dep_date[0] ? o->dep_date : "-", o->dep_time[0] ? o->dep_time : "-", &v->departed);
+            v->membership = o->membership; v->total_hrs = o->total_hrs; v->space_id = o->space_id;
+            v->parks = o->parks; v->revenue = o->revenue;
+        }
+    }
+    return out;
+}
+
+// Writes and atomically renames the snapshot without printing anything, so a forked
+// checkpoint child can use it; the final header is returned in *out.
+bool writeSnapshot(const char *fname, SnapHeader *out) {
+    bool ok = false;
+    char tmp_name[256];
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", fname);
+    FILE *fp = fopen(tmp_name, "wb");
+
+    if (fp) {
+        SnapHeader hdr; memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC));
+        hdr.version = SNAP_VERSION;
+        hdr.vehicle_size = sizeof(Vehicle);
+        hdr.space_size = sizeof(ParkingSpace);
+        hdr.vehicles_sum = hdr.spaces_sum = CHECKSUM_SEED;
+        hdr.last_lsn = cur_lot->journal.next_lsn - 1;
+        fwrite(&hdr, sizeof(hdr), 1, fp); // Rewritten once counts and sums are known
+
+        LeafIter it = iterBegin(cur_lot->v_root);
+        Vehicle *v;
+        while ((v = iterNextV(&it)) != NULL) {
+            Vehicle rec;
+            memset(&rec, 0, sizeof(rec)); // Zero padding so checksums are reproducible
+            strcpy(rec.v_num, v->v_num); strcpy(rec.owner, v->owner);
+            rec.arrived = v->arrived; rec.departed = v->departed;
+            rec.membership = v->membership; rec.total_hrs = v->total_hrs; rec.space_id = v->space_id;
+            rec.parks = v->parks; rec.revenue = v->revenue;
+            fwrite(&rec, sizeof(rec), 1, fp);
+            hdr.vehicles_sum = checksum(hdr.vehicles_sum, &rec, sizeof(rec));
+            hdr.nvehicles++;
+        }
+
+        it = iterBegin(cur_lot->s_root);
+        ParkingSpace *sp;
+        while ((sp = iterNextS(&it)) != NULL) {
+            fwrite(sp, sizeof(ParkingSpace), 1, fp);
+            hdr.spaces_sum = checksum(hdr.spaces_sum, sp, sizeof(ParkingSpace));
+            hdr.nspaces++;
+        }
+
+        hdr.header_sum = checksum(CHECKSUM_SEED, &hdr, offsetof(SnapHeader, header_sum));
+        rewind(fp);
+        fwrite(&hdr, sizeof(hdr), 1, fp);
+        ok = !ferror(fp) && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+        if (fclose(fp) != 0) ok = false;
+
+        if (ok && rename(tmp_name, fname) != 0) ok = false;
+        if (!ok) unlink(tmp_name);
+        *out = hdr;
+    }
+    return ok;
+}
+
+bool saveSnapshot(const char *fname) {
+    SnapHeader hdr;
+    bool ok = writeSnapshot(fname, &hdr);
+    if (ok) {
+        printf("Snapshot saved to %s (%llu vehicles, %llu spaces).\n", fname,
+               (unsigned long long)hdr.nvehicles, (unsigned long long)hdr.nspaces);
+    } else {
+        perror("Err writing snapshot");
+        fprintf(stderr, "Err: Failed to write snapshot %s.\n", fname);
+    }
+    return ok;
+}
+
+// Maps a snapshot, verifies it and bulk loads both trees from the mapped records.
+// Returns false (leaving the trees empty) if the file is missing or invalid.
+bool loadSnapshot(const char *fname) {
+    bool ok = false;
+    MappedFile mf;
+
+    if (mapFile(fname, &mf)) {
+        const SnapHeader *hdr = (const SnapHeader *)mf.data;
+        const char *problem = NULL;
+
+        if (mf.size < sizeof(SnapHeader) || memcmp(hdr->magic, SNAP_MAGIC, sizeof(SNAP_MAGIC)) != 0) {
+            problem = "not a snapshot file";
+        } else if (hdr->header_sum != checksum(CHECKSUM_SEED, hdr, offsetof(SnapHeader, header_sum))) {
+            problem = "header checksum mismatch";
+        } else if (!((hdr->version == SNAP_VERSION && hdr->vehicle_size == sizeof(Vehicle)) ||
+                     (hdr->version == 2 && hdr->vehicle_size == sizeof(VehicleV2))) ||
+                   hdr->space_size != sizeof(ParkingSpace)) {
+            problem = "unsupported version or record layout";
+        } else if (mf.size != sizeof(SnapHeader) + hdr->nvehicles * hdr->vehicle_size + hdr->nspaces * sizeof(ParkingSpace)) {
+            problem = "truncated file";
+        }
+
+        const char *vehicles = mf.data + sizeof(SnapHeader);
+        const ParkingSpace *spaces = NULL;
+        Vehicle *converted = NULL;
+        if (!problem) {
+            spaces = (const ParkingSpace *)(vehicles + hdr->nvehicles * hdr->vehicle_size);
+            if (checksumRecords(vehicles, hdr->nvehicles, hdr->vehicle_size) != hdr->vehicles_sum ||
+                checksumRecords(spaces, hdr->nspaces, sizeof(ParkingSpace)) != hdr->spaces_sum) {
+                problem = "record checksum mismatch";
+            } else if (hdr->version == 2) {
+                converted = convertVehiclesV2((const VehicleV2 *)vehicles, hdr->nvehicles);
+                if (!converted) problem = "out of memory converting version 2 records";
+                else vehicles = (const char *)converted;
+            }
+        }
+
+        if (problem) {
+            fprintf(stderr, "Warn: Ignoring snapshot %s: %s.\n", fname, problem);
+        } else {
+            cur_lot->s_root = bulkLoadSpaces(spaces, (int)hdr->nspaces);
+            cur_lot->v_root = bulkLoadVehicles((const Vehicle *)vehicles, (int)hdr->nvehicles);
+            cur_lot->journal.next_lsn = hdr->last_lsn + 1;
+            printf("Loaded snapshot %s: %llu vehicles, %llu spaces.\n", fname,
+                   (unsigned long long)hdr->nvehicles, (unsigned long long)hdr->nspaces);
+            ok = true;
+        }
+        free(converted);
+        unmapFile(&mf);
+    }
+    return ok;
+}
+
+// Re-applies journaled events newer than the loaded state and cuts off a torn tail.
+void journalReplay(const char *fname) {
+    Journal *jr = &cur_lot->journal;
+    MappedFile mf;
+    if (mapFile(fname, &mf)) {
+        uint64_t base_lsn = jr->next_lsn - 1;
+        size_t off = 0; int applied = 0, failed = 0;
+        bool valid = true, prev_quiet = gate_quiet;
+        gate_quiet = true;
+
+        while (valid && off + sizeof(JournalRecHdr) <= mf.size) {
+            JournalRecHdr hdr;
+            memcpy(&hdr, mf.data + off, sizeof(hdr));
+            if (hdr.len != sizeof(hdr) + hdr.plate_len + hdr.owner_len || off + hdr.len > mf.size ||
+                (hdr.plate_len == 0 && hdr.type != J_DROP_SPACE) || hdr.plate_len > 19 || hdr.owner_len > 49 ||
+                hdr.sum != (uint32_t)checksum(CHECKSUM_SEED, mf.data + off + sizeof(uint32_t), hdr.len - sizeof(uint32_t))) {
+                valid = false;
+            } else {
+                if (hdr.lsn > base_lsn) {
+                    char v_num[20] = {0}, owner[50] = {0};
+                    memcpy(v_num, mf.data + off + sizeof(hdr), hdr.plate_len);
+                    memcpy(owner, mf.data + off + sizeof(hdr) + hdr.plate_len, hdr.owner_len);
+                    bool ok = false;
+                    switch (hdr.type) {
+                        case J_ENTRY: ok = admitVehicle(v_num, owner, (time_t)hdr.ts, hdr.space_id); break;
+                        case J_EXIT: ok = departVehicle(v_num, (time_t)hdr.ts); break;
+                        case J_ARCHIVE: ok = retireVehicle(v_num); break;
+                        case J_DROP_SPACE: ok = retireSpace(hdr.space_id); break;
+                    }
+                    if (ok) applied++; else failed++;
+                }
+                if (hdr.lsn >= jr->next_lsn) jr->next_lsn = hdr.lsn + 1;
+                off += hdr.len;
+            }
+        }
+        gate_quiet = prev_quiet;
+
+        if (off < mf.size) {
+            fprintf(stderr, "Warn: %s: discarding %zu bytes of torn/corrupt records at offset %zu.\n",
+                    fname, mf.size - off, off);
+            if (truncate(fname, (off_t)off) != 0) perror("Err truncating journal");
+        }
+        unmapFile(&mf);
+        if (applied > 0 || failed > 0) {
+            printf("Replayed %d journaled events from %s.", applied, fname);
+            if (failed > 0) printf(" %d did not apply.", failed);
+            printf("\n");
+        }
+    }
+}
+
+// Forks a child that writes the snapshot from its copy-on-write view of memory.
+// Gates are held off only for the fork itself; the journal is trimmed once the snapshot is durable.
+bool runCheckpoint() {
+    Checkpointer *cp = &cur_lot->checkpointer;
+    bool ok = false;
+    pthread_rwlock_wrlock(&cur_lot->state_lock);
+    uint64_t lsn = cur_lot->journal.next_lsn - 1;
+    char path[LOT_PATH_MAX];
+    fflush(NULL); // Otherwise the child inherits and may re-emit buffered output
+    pid_t pid = fork();
+    if (pid == 0) {
+        SnapHeader hdr;
+        _exit(writeSnapshot(lotFile(SNAPSHOT_FILE, path), &hdr) ? 0 : 1);
+    }
+    pthread_rwlock_unlock(&cur_lot->state_lock);
+
+    if (pid < 0) {
+        perror("Err forking checkpoint");
+    } else {
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (ok) {
+            journalTruncateUpTo(lotFile(JOURNAL_FILE, path), lsn);
+            pthread_mutex_lock(&cp->lock);
+            cp->last_done = time(NULL);
+            cp->last_lsn = lsn;
+            pthread_mutex_unlock(&cp->lock);
+        } else {
+            fprintf(stderr, "Err: Background checkpoint failed.\n");
+        }
+    }
+    return ok;
+}
+
+void *checkpointLoop(void *arg) {
+    useLot((Lot *)arg);
+    Checkpointer *c = &cur_lot->checkpointer;
+    pthread_mutex_lock(&c->lock);
+    while (c->running) {
+        if (!c->requested) {
+            if (c->interval_s > 0) {
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_sec += c->interval_s;
+                if (pthread_cond_timedwait(&c->wake, &c->lock, &deadline) == ETIMEDOUT) c->requested = true;
+            } else {
+                pthread_cond_wait(&c->wake, &c->lock);
+            }
+        }
+        if (c->running && c->requested) {
+            c->requested = false;
+            pthread_mutex_unlock(&c->lock);
+            runCheckpoint();
+            pthread_mutex_lock(&c->lock);
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+void startCheckpointer() {
+    Checkpointer *cp = &cur_lot->checkpointer;
+    cp->running = true;
+    if (pthread_create(&cp->tid, NULL, checkpointLoop, cur_lot) != 0) {
+        fprintf(stderr, "Warn: Background checkpoints unavailable.\n");
+        cp->running = false;
+    }
+}
+
+void requestCheckpoint() {
+    Checkpointer *cp = &cur_lot->checkpointer;
+    pthread_mutex_lock(&cp->lock);
+    if (cp->running) {
+        cp->requested = true;
+        pthread_cond_signal(&cp->wake);
+        printf("Checkpoint started in background.\n");
+    } else {
+        printf("Err: Checkpointer not running.\n");
+    }
+    if (cp->last_done) {
+        printf("Last checkpoint covered journal LSN %llu.\n", (unsigned long long)cp->last_lsn);
+    }
+    pthread_mutex_unlock(&cp->lock);
+}
+
+// Waits for an in-flight checkpoint to finish and stops the thread.
+void stopCheckpointer() {
+    Checkpointer *cp = &cur_lot->checkpointer;
+    if (cp->running) {
+        pthread_mutex_lock(&cp->lock);
+        cp->running = false;
+        pthread_cond_signal(&cp->wake);
+        pthread_mutex_unlock(&cp->lock);
+        pthread_join(cp->tid, NULL);
+    }
+}
+
+// Frees the bound lot's trees, record store, index, allocator and rankings.
+void freeLotData() {
+    freeTree(&cur_lot->v_root, &cur_lot->v_pool);
+    freeVehicleStore();
+    freePlateIndex(&cur_lot->v_index);
+    freeTree(&cur_lot->s_root, &cur_lot->s_pool);
+    freeAllocator();
+    freeRankings();
+}
+
+void saveDataAndFree() {
+    char path[LOT_PATH_MAX];
+    stopCheckpointer();
+    printf("\n--- Saving Data ---\n");
+    saveVehiclesToFile(cur_lot->v_root, lotFile("bplus-vehicle-database.txt", path));
+    saveSpacesToFile(cur_lot->s_root, lotFile("bplus-parking-lot-data.txt", path));
+    if (saveSnapshot(lotFile(SNAPSHOT_FILE, path))) {
+        journalReset(); // Every journaled event is now in the snapshot
+    }
+    journalClose();
+
+    printf("\n--- Freeing Memory ---\n");
+    freeLotData();
+    printf("Vehicle tree freed.\n");
+    printf("Space tree freed.\n");
+}
+
+typedef struct OpenOptions {
+    bool import_text;
+    int archive_days; // < 0: no archiving at startup
+} OpenOptions;
+
+// Loads the lot from its snapshot (or text files), replays its journal and starts its checkpointer.
+void openLot(Lot *lot, void *arg) {
+    const OpenOptions *opt = (const OpenOptions *)arg;
+    char snap[LOT_PATH_MAX], jpath[LOT_PATH_MAX], bak[LOT_PATH_MAX + 8];
+    lotFile(SNAPSHOT_FILE, snap);
+    lotFile(JOURNAL_FILE, jpath);
+    if (nlots > 1) printf("--- Lot %s ---\n", lot->name);
+    if (opt->import_text || !loadSnapshot(snap)) {
+        loadSpaces();
+        loadVehicles();
+    }
+    initAllocator();
+    if (opt->import_text) {
+        // The journal belonged to the old snapshot; keep it aside and start a new base
+        snprintf(bak, sizeof(bak), "%s.bak", jpath);
+        if (rename(jpath, bak) == 0) {
+            printf("Info: Moved old journal to %s.\n", bak);
+        }
+    } else {
+        journalReplay(jpath);
+    }
+    journalOpen(jpath);
+    if (opt->import_text) saveSnapshot(snap);
+    if (opt->archive_days >= 0) archiveDormantVehicles(lot, opt->archive_days, time(NULL));
+    startCheckpointer();
+}
+
+void closeLot(Lot *lot, void *arg) {
+    (void)lot; (void)arg;
+    saveDataAndFree();
+}
+
+// Frees the lot without writing its files; the journal still holds its unsaved events.
+void discardLot(Lot *lot, void *arg) {
+    (void)lot; (void)arg;
+    stopCheckpointer();
+    journalClose();
+    freeLotData();
+}
+
+// Frees every lot, saving it first when `save` is set, each on its own worker when lots are pinned.
+void closeAllLots(bool save) {
+    for (int i = 0; i < nlots; i++) lotSubmit(lots[i], save ? closeLot : discardLot, NULL);
+    for (int i = 0; i < nlots; i++) lotWait(lots[i]);
+}
+
+int treeHeight(BPlusTreeNode *node) {
+    int h = 0;
+    while (node) {
+        h++;
+        node = node->leaf_flag ? NULL : node->data.internal.child[0];
+    }
+    return h;
+}
+
+long countNodes(BPlusTreeNode *node) {
+    long cnt = 0;
+    if (node) {
+        cnt = 1;
+        if (!node->leaf_flag) {
+            for (int i = 0; i <= node->nkeys; i++) cnt += countNodes(node->data.internal.child[i]);
+        }
+    }
+    return cnt;
+}
+
+// Leaves and keys along the leaf chain, for the fill factor.
+void countLeaves(BPlusTreeNode *node, long *leaves, long *keys) {
+    *leaves = 0; *keys = 0;
+    for (BPlusTreeNode *l = iterBegin(node).leaf; l; l = l->data.leaf.next) {
+        (*leaves)++;
+        *keys += l->nkeys;
+    }
+}
+
+// Upper edge in microseconds of the bucket holding the p-th fraction of operations.
+double histPercentile(const LatencyHist *h, double p) {
+    unsigned long long seen = 0, want = (unsigned long long)ceil(p * (double)h->count);
+    int b = 0;
+    while (b < STAT_BUCKETS - 1 && (seen += h->buckets[b]) < want) b++;
+    return h->count ? (double)(2ULL << b) / 1000.0 : 0.0;
+}
+
+typedef struct TreeStats {
+    int height;
+    long nodes, leaves, keys;
+    double fill;
+} TreeStats;
+
+TreeStats treeStats(BPlusTreeNode *root, int max_keys) {
+    TreeStats t;
+    t.height = treeHeight(root);
+    t.nodes = countNodes(root);
+    countLeaves(root, &t.leaves, &t.keys);
+    t.fill = t.leaves ? (double)t.keys / ((double)t.leaves * max_keys) : 0.0;
+    return t;
+}
+
+// Prints the bound lot's counters and tree shape; with json set, as one JSON object.
+void printStats(FILE *fp, bool json) {
+    Lot *lot = cur_lot;
+    LotStats st = lot->stats; // Counters may move while printing; a torn copy is fine
+    st.entry.count = st.exit.count = 0;
+    for (int b = 0; b < STAT_BUCKETS; b++) {
+        st.entry.count += st.entry.buckets[b];
+        st.exit.count += st.exit.buckets[b];
+    }
+    pthread_rwlock_rdlock(&lot->state_lock);
+    TreeStats vt = treeStats(lot->v_root, V_ORDER - 1), s_t = treeStats(lot->s_root, S_ORDER - 1);
+    pthread_rwlock_unlock(&lot->state_lock);
+    long up = (long)(time(NULL) - st.since);
+    double splits_s = up > 0 ? (double)(st.v_splits + st.s_splits) / up : (double)(st.v_splits + st.s_splits);
+    double cmps = st.v_descents ? (double)st.v_descent_cmps / st.v_descents : 0.0;
+    double words = st.allocs ? (double)st.alloc_words / st.allocs : 0.0;
+    const LatencyHist *gates[2] = { &st.entry, &st.exit };
+    const char *gate_names[2] = { "entry", "exit" };
+
+    if (json) {
+        fprintf(fp, "{\n  \"lot\": \"%s\", \"uptime_s\": %ld,\n", lot->name, up);
+        fprintf(fp, "  \"vehicle_tree\": {\"height\": %d, \"nodes\": %ld, \"leaves\": %ld, \"keys\": %ld, \"leaf_fill\": %.4f},\n",
+                vt.height, vt.nodes, vt.leaves, vt.keys, vt.fill);
+        fprintf(fp, "  \"space_tree\": {\"height\": %d, \"nodes\": %ld, \"leaves\": %ld, \"keys\": %ld, \"leaf_fill\": %.4f},\n",
+                s_t.height, s_t.nodes, s_t.leaves, s_t.keys, s_t.fill);
+        fprintf(fp, "  \"splits\": {\"vehicle\": %llu, \"space\": %llu, \"per_s\": %.3f},\n", st.v_splits, st.s_splits, splits_s);
+        fprintf(fp, "  \"nodes_created\": %llu,\n", st.nodes_created);
+        fprintf(fp, "  \"find_leaf_v\": {\"descents\": %llu, \"comparisons\": %llu, \"per_descent\": %.3f},\n",
+                st.v_descents, st.v_descent_cmps, cmps);
+        fprintf(fp, "  \"allocate_space\": {\"calls\": %llu, \"words_scanned\": %llu, \"per_call\": %.3f},\n",
+                st.allocs, st.alloc_words, words);
+        for (int g = 0; g < 2; g++) {
+            const LatencyHist *h = gates[g];
+            fprintf(fp, "  \"%s\": {\"count\": %llu, \"mean_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f, \"buckets_ns_log2\": [",
+                    gate_names[g], h->count, h->count ? h->total_ns / 1000.0 / h->count : 0.0,
+                    histPercentile(h, 0.5), histPercentile(h, 0.99), histPercentile(h, 0.999));
+            for (int b = 0; b < STAT_BUCKETS; b++) fprintf(fp, "%s%llu", b ? ", " : "", h->buckets[b]);
+            fprintf(fp, "]}%s\n", g ? "" : ",");
+        }
+        fprintf(fp, "}\n");
+    } else {
+        fprintf(fp, "\n--- Engine Stats: lot %s, %ld s ---\n", lot->name, up);
+        fprintf(fp, "Vehicle tree: height %d, %ld nodes, %ld leaves, leaf fill %.1f%%\n",
+                vt.height, vt.nodes, vt.leaves, vt.fill * 100.0);
+        fprintf(fp, "Space tree:   height %d, %ld nodes, %ld leaves, leaf fill %.1f%%\n",
+                s_t.height, s_t.nodes, s_t.leaves, s_t.fill * 100.0);
+        fprintf(fp, "Splits: %llu vehicle, %llu space (%.3f/s); nodes created: %llu\n",
+                st.v_splits, st.s_splits, splits_s, st.nodes_created);
+        fprintf(fp, "findLeafNodeV: %llu descents, %.2f comparisons each\n", st.v_descents, cmps);
+        fprintf(fp, "allocateSpace: %llu calls, %.2f bitmap words scanned each\n", st.allocs, words);
+        for (int g = 0; g < 2; g++) {
+            const LatencyHist *h = gates[g];
+            fprintf(fp, "Gate %-5s: %llu ops, mean %.2f us, p50 <= %.2f us, p99 <= %.2f us, p999 <= %.2f us\n",
+                    gate_names[g], h->count, h->count ? h->total_ns / 1000.0 / h->count : 0.0,
+                    histPercentile(h, 0.5), histPercentile(h, 0.99), histPercentile(h, 0.999));
+        }
+    }
+}
+
+// Shows the stats and writes them as JSON next to the lot's data files.
+void showStats() {
+    char path[LOT_PATH_MAX];
+    printStats(stdout, false);
+    FILE *fp = fopen(lotFile(STATS_FILE, path), "w");
+    if (!fp) {
+        fprintf(stderr, "Err: Cannot write %s.\n", path);
+    } else {
+        printStats(fp, true);
+        fclose(fp);
+        printf("Stats written to %s.\n", path);
+    }
+}
+
+double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned long long bench_rng = 88172645463325252ULL;
+
+unsigned long long benchRand() {
+    bench_rng ^= bench_rng << 13; bench_rng ^= bench_rng >> 7; bench_rng ^= bench_rng << 17;
+    return bench_rng;
+}
+
+// Random plate in the KA01MX1234 layout.
+void benchPlate(char *buf) {
+    unsigned long long r = benchRand();
+    sprintf(buf, "%c%c%02d%c%c%04d", 'A' + (int)(r % 26), 'A' + (int)(r / 26 % 26), (int)(r / 676 % 100),
+            'A' + (int)(r / 67600 % 26), 'A' + (int)(r / 1757600 % 26), (int)(r / 45697600 % 10000));
+}
+
+void runTreeBenchmark(int n) {
+    char (*plates)[20] = malloc((size_t)n * sizeof(*plates));
+    if (!plates) {
+        fprintf(stderr, "Err: Cannot allocate %d plates for benchmark.\n", n);
+    } else {
+        printf("--- Tree Benchmark: %d vehicles, V_ORDER %d, S_ORDER %d, nodes %zu bytes (vehicle) / %zu bytes (space) ---\n",
+               n, V_ORDER, S_ORDER, (size_t)V_NODE_SIZE, (size_t)S_NODE_SIZE);
+        Vehicle v; memset(&v, 0, sizeof(Vehicle));
+        strcpy(v.owner, "Bench");
+        for (int i = 0; i < n; i++) benchPlate(plates[i]);
+
+        double t0 = nowSeconds();
+        for (int i = 0; i < n; i++) {
+            strcpy(v.v_num, plates[i]);
+            insertVehicle(v);
+        }
+        double t1 = nowSeconds();
+        printf("Insert: %.3f s (%.0f ns/op)\n", t1 - t0, (t1 - t0) * 1e9 / n);
+        printf("Vehicle tree: height %d, %ld nodes\n", treeHeight(cur_lot->v_root), countNodes(cur_lot->v_root));
+
+        int found = 0;
+        t0 = nowSeconds();
+        for (int i = 0; i < n; i++) {
+            if (findVehicle(cur_lot->v_root, plates[benchRand() % n])) found++;
+        }
+        t1 = nowSeconds();
+        printf("Lookup: %.3f s (%.0f ns/op), %d/%d found\n", t1 - t0, (t1 - t0) * 1e9 / n, found, n);
+
+        for (int i = 1; i <= n; i++) {
+            ParkingSpace s = {i, 0, 0.0, 0.0};
+            insertSpace(s);
+        }
+        found = 0;
+        t0 = nowSeconds();
+        for (int i = 0; i < n; i++) {
+            if (findSpace(cur_lot->s_root, 1 + (int)(benchRand() % n))) found++;
+        }
+        t1 = nowSeconds();
+        printf("Space tree: height %d, %ld nodes\n", treeHeight(cur_lot->s_root), countNodes(cur_lot->s_root));
+        printf("Space lookup: %.3f s (%.0f ns/op), %d/%d found\n", t1 - t0, (t1 - t0) * 1e9 / n, found, n);
+
+        freeTree(&cur_lot->v_root, &cur_lot->v_pool);
+        freeVehicleStore();
+        freePlateIndex(&cur_lot->v_index);
+        freeTree(&cur_lot->s_root, &cur_lot->s_pool);
+        free(plates);
+    }
+}
+
+#define REPLAY_BATCH 4096
+#define REPLAY_MAX_ERRS 20
+
+typedef struct GateEvent {
+    int type; // J_ENTRY or J_EXIT
+    int line;
+    time_t ts;
+    char v_num[20];
+    char owner[50];
+} GateEvent;
+
+typedef struct ReplayOptions {
+    const char *fname; // "-" reads stdin
+    int batch;
+    bool sort_batch;
+    bool log;
+} ReplayOptions;
+
+// Parses "ENTRY DDMMYYYY HHMM PLATE OWNER..." or "EXIT DDMMYYYY HHMM PLATE".
+const char *parseEventLine(const char *p, const char *eol, GateEvent *ev) {
+    const char *err = NULL;
+    char kind[6], date[9], tm_str[5];
+    EpochMin m;
+    memset(ev, 0, sizeof(GateEvent));
+
+    if (readToken(&p, eol, kind, 5) <= 0) err = "missing event type";
+    else if (strcmp(kind, "ENTRY") == 0) ev->type = J_ENTRY;
+    else if (strcmp(kind, "EXIT") == 0) ev->type = J_EXIT;
+    else err = "unknown event type";
+
+    if (!err && (readToken(&p, eol, date, 8) <= 0 || readToken(&p, eol, tm_str, 4) <= 0 ||
+                 !parseStamp(date, tm_str, &m) || m == STAMP_NONE)) {
+        err = "bad date or time";
+    }
+    if (!err) {
+        ev->ts = (time_t)m * 60;
+        int len = readToken(&p, eol, ev->v_num, sizeof(ev->v_num) - 1);
+        if (len <= 0) err = (len == 0) ? "missing vehicle number" : "vehicle number too long";
+    }
+    if (!err && ev->type == J_ENTRY) {
+        skipSpaces(&p, eol);
+        const char *end = eol;
+        while (end > p && isspace((unsigned char)end[-1])) end--;
+        if (end == p) err = "missing owner name";
+        else if (end - p > (long)sizeof(ev->owner) - 1) err = "owner name too long";
+        else { memcpy(ev->owner, p, end - p); ev->owner[end - p] = '\0'; }
+    }
+    return err;
+}
+
+int compareEventsByPlate(const void *a, const void *b) {
+    return strcmp(((const GateEvent *)a)->v_num, ((const GateEvent *)b)->v_num);
+}
+
+// Applies one batch through the normal gates. Sorting groups a plate's events so
+// consecutive lookups touch the same leaf; the merge sort is stable, so each plate
+// still sees its own events in file order.
+void applyEventBatch(Lot *lot, GateEvent *evs, int n, bool sort_batch, long *applied, long *rejected) {
+    if (sort_batch) sortRecords(evs, (size_t)n, sizeof(GateEvent), compareEventsByPlate);
+    for (int i = 0; i < n; i++) {
+        bool ok = (evs[i].type == J_ENTRY) ? vehicleEntry(lot, evs[i].v_num, evs[i].owner, evs[i].ts)
+                                           : vehicleExit(lot, evs[i].v_num, evs[i].ts);
+        if (ok) (*applied)++;
+        else (*rejected)++;
+    }
+}
+
+// Feeds a file of timestamped gate events into the lot in batches, without the menu.
+// Returns false if the file cannot be read.
+bool replayEvents(Lot *lot, const ReplayOptions *opt) {
+    bool success = true;
+    bool from_stdin = strcmp(opt->fname, "-") == 0;
+    FILE *fp = from_stdin ? stdin : fopen(opt->fname, "r");
+    GateEvent *batch = (GateEvent *)malloc((size_t)opt->batch * sizeof(GateEvent));
+
+    if (!fp || !batch) {
+        fprintf(stderr, "Err: Cannot replay %s.\n", opt->fname);
+        success = false;
+    } else {
+        char *line = NULL; size_t cap = 0; ssize_t len;
+        int n = 0, line_no = 0, bad = 0;
+        long applied = 0, rejected = 0;
+        gate_quiet = !opt->log;
+        double t0 = nowSeconds();
+        while ((len = getline(&line, &cap, fp)) != -1) {
+            const char *p = line, *eol = line + len;
+            line_no++;
+            if (eol > p && eol[-1] == '\n') eol--;
+            skipSpaces(&p, eol);
+            if (p == eol || *p == '#') continue;
+            const char *err = parseEventLine(p, eol, &batch[n]);
+            if (err) {
+                if (++bad <= REPLAY_MAX_ERRS) fprintf(stderr, "Err: %s line %d: %s.\n", opt->fname, line_no, err);
+            } else {
+                batch[n].line = line_no;
+                if (++n == opt->batch) {
+                    applyEventBatch(lot, batch, n, opt->sort_batch, &applied, &rejected);
+                    n = 0;
+                }
+            }
+        }
+        applyEventBatch(lot, batch, n, opt->sort_batch, &applied, &rejected);
+        double t1 = nowSeconds();
+        gate_quiet = false;
+        free(line);
+
+        long total = applied + rejected;
+        printf("Replayed %ld events from %s in %.3f s (%.0f events/s): %ld applied, %ld rejected, %d bad lines.\n",
+               total, opt->fname, t1 - t0, t1 > t0 ? total / (t1 - t0) : 0.0, applied, rejected, bad);
+    }
+    if (fp && !from_stdin) fclose(fp);
+    free(batch);
+    return success;
+}
+
+typedef struct ReplayJob {
+    ReplayOptions opt;
+    bool ok;
+} ReplayJob;
+
+void replayLot(Lot *lot, void *arg) {
+    ReplayJob *job = (ReplayJob *)arg;
+    job->ok = replayEvents(lot, &job->opt);
+}
+
+#define STRESS_SPACES 1000
+#define STRESS_PLATES 4000
+#define STRESS_OPS 400000
+
+typedef struct GateStress {
+    Lot *lot;
+    int id, ops;
+    char (*plates)[20];
+    time_t base;
+    long entries, exits, rejected;
+} GateStress;
+
+// One gate: random entries and exits over a shared plate pool, so gates collide on
+// plates, on free spaces and on first-time registrations.
+void *stressGate(void *arg) {
+    GateStress *g = (GateStress *)arg;
+    gate_quiet = true;
+    unsigned long long rng = 0x9E3779B97F4A7C15ULL * (unsigned long long)(g->id + 1);
+    for (int i = 0; i < g->ops; i++) {
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        const char *plate = g->plates[rng % STRESS_PLATES];
+        time_t now = g->base + i;
+        if ((rng >> 40) & 1) {
+            if (vehicleEntry(g->lot, plate, "Stress", now)) g->entries++;
+            else g->rejected++;
+        } else {
+            if (vehicleExit(g->lot, plate, now)) g->exits++;
+            else g->rejected++;
+        }
+    }
+    return NULL;
+}
+
+// Checks a subtree: parent links, ascending separators, at least one key in every node
+// below the root, and every leaf at the same depth. Returns the number of violations.
+// Plates longer than a code share it, so equal vehicle separators are legal when inexact.
+int checkTreeShape(const BPlusTreeNode *node, int depth, int *leaf_depth, bool vehicles) {
+    int bad = 0;
+    if (node->parent && node->nkeys < 1) bad++;
+    if (node->leaf_flag) {
+        if (*leaf_depth < 0) *leaf_depth = depth;
+        if (depth != *leaf_depth) bad++;
+    } else {
+        for (int i = 1; i < node->nkeys; i++) {
+            if (vehicles) {
+                PlateKey lo = node->data.internal.int_vkeys[i - 1], hi = node->data.internal.int_vkeys[i];
+                if (lo > hi || (lo == hi && !(lo & PLATE_INEXACT))) bad++;
+            } else if (node->data.internal.int_skeys[i - 1] >= node->data.internal.int_skeys[i]) {
+                bad++;
+            }
+        }
+        for (int i = 0; i <= node->nkeys; i++) {
+            const BPlusTreeNode *c = node->data.internal.child[i];
+            if (!c || c->parent != node) bad++;
+            else bad += checkTreeShape(c, depth + 1, leaf_depth, vehicles);
+        }
+    }
+    return bad;
+}
+
+int treeViolations() {
+    int bad = 0, v_depth = -1, s_depth = -1;
+    if (cur_lot->v_root) bad += checkTreeShape(cur_lot->v_root, 0, &v_depth, true);
+    if (cur_lot->s_root) bad += checkTreeShape(cur_lot->s_root, 0, &s_depth, false);
+    return bad;
+}
+
+// Cross-checks vehicles, spaces, allocator bitmaps and the plate index of the bound lot.
+// Returns the number of violations found.
+int checkGateInvariants(long expect_parked) {
+    int bad = 0;
+    long parked = 0, occupied = 0, free_bits = 0, vehicles = 0;
+    int *holder = (int *)calloc(STRESS_SPACES + 1, sizeof(int));
+    LeafIter it = iterBegin(cur_lot->v_root);
+    Vehicle *v;
+    while (holder && (v = iterNextV(&it)) != NULL) {
+        vehicles++;
+        if (findVehicle(cur_lot->v_root, v->v_num) != v) bad++;
+        if (isParked(v)) {
+            parked++;
+            if (v->space_id < 1 || v->space_id > STRESS_SPACES || holder[v->space_id]++) {
+                fprintf(stderr, "Err: Space %d held twice (V# %s).\n", v->space_id, v->v_num);
+                bad++;
+            } else if (vstoreGet(spaceOccupant(cur_lot, v->space_id)) != v) {
+                fprintf(stderr, "Err: Space %d does not list V# %s as occupant.\n", v->space_id, v->v_num);
+                bad++;
+            }
+        }
+    }
+    it = iterBegin(cur_lot->s_root);
+    ParkingSpace *sp;
+    while (holder && (sp = iterNextS(&it)) != NULL) {
+        const SpaceTier *t = &cur_lot->s_alloc.tiers[tierOfSpace(sp->id)];
+        int bit = sp->id - t->first;
+        bool is_free = (t->free_bits[bit / 64] >> (bit % 64)) & 1;
+        if (sp->status == 1) occupied++;
+        if (is_free) free_bits++;
+        if (is_free == (sp->status == 1) || (sp->status == 1) != (holder[sp->id] == 1)) {
+            fprintf(stderr, "Err: Space %d status %d, bitmap %s, %d holders.\n",
+                    sp->id, sp->status, is_free ? "free" : "taken", holder[sp->id]);
+            bad++;
+        }
+    }
+    int nfree = 0, noccupied = 0;
+    for (int t = 0; t < NUM_TIERS; t++) {
+        nfree += cur_lot->s_alloc.tiers[t].nfree;
+        noccupied += cur_lot->s_alloc.tiers[t].noccupied;
+    }
+    if (parked != expect_parked || parked != occupied || nfree != free_bits || noccupied != occupied ||
+        occupied + free_bits != STRESS_SPACES || (long)cur_lot->v_index.count != vehicles) {
+        fprintf(stderr, "Err: parked %ld (expected %ld), occupied %ld, free %ld (counted %d), vehicles %ld, indexed %u.\n",
+                parked, expect_parked, occupied, free_bits, nfree, vehicles, cur_lot->v_index.count);
+        bad++;
+    }
+    free(holder);
+    return bad + treeViolations();
+}
+
+// Runs n gate threads against one in-memory lot and checks that no space was handed
+// out twice and that trees, index and allocator still agree.
+int runGateStress(int n) {
+    int bad = 0;
+    GateStress *gates = (GateStress *)calloc((size_t)n, sizeof(GateStress));
+    pthread_t *tids = (pthread_t *)calloc((size_t)n, sizeof(pthread_t));
+    char (*plates)[20] = malloc(STRESS_PLATES * sizeof(*plates));
+    if (!gates || !tids || !plates) {
+        fprintf(stderr, "Err: Cannot allocate gate stress test.\n");
+        bad = 1;
+    } else {
+        printf("--- Gate Stress: %d gates, %d ops, %d spaces, %d plates ---\n",
+               n, STRESS_OPS, STRESS_SPACES, STRESS_PLATES);
+        for (int i = 0; i < STRESS_PLATES; i++) {
+            if (i % 8) benchPlate(plates[i]);
+            else snprintf(plates[i], sizeof(plates[i]), "KA01LONGPLATE%06d", i); // Equal inexact codes
+        }
+        for (int i = 1; i <= STRESS_SPACES; i++) {
+            ParkingSpace s = {i, 0, 0.0, 0.0};
+            insertSpace(s);
+        }
+        initAllocator();
+
+        time_t base = time(NULL);
+        double t0 = nowSeconds();
+        int started = 0;
+        for (int i = 0; i < n; i++) {
+            gates[i] = (GateStress){ cur_lot, i, STRESS_OPS / n, plates, base, 0, 0, 0 };
+            if (pthread_create(&tids[i], NULL, stressGate, &gates[i]) == 0) started++;
+            else fprintf(stderr, "Err: Cannot start gate %d.\n", i);
+        }
+        for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+        double t1 = nowSeconds();
+
+        long entries = 0, exits = 0, rejected = 0;
+        for (int i = 0; i < started; i++) {
+            entries += gates[i].entries; exits += gates[i].exits; rejected += gates[i].rejected;
+        }
+        long ops = entries + exits + rejected;
+        printf("%ld ops in %.3f s (%.0f ops/s): %ld entries, %ld exits, %ld rejected\n",
+               ops, t1 - t0, ops / (t1 - t0), entries, exits, rejected);
+        bad = checkGateInvariants(entries - exits);
+        printf("Invariants: %s (%d violations)\n", bad ? "FAILED" : "ok", bad);
+
+        freeTree(&cur_lot->v_root, &cur_lot->v_pool);
+        freeVehicleStore();
+        freePlateIndex(&cur_lot->v_index);
+        freeTree(&cur_lot->s_root, &cur_lot->s_pool);
+        freeAllocator();
+    }
+    free(gates); free(tids); free(plates);
+    return bad;
+}
+
+// Bulk loads n vehicles and n spaces at several fill factors, down to sparse ones, then
+// deletes every record in random order, checking the tree shape as it goes.
+int runBulkStress(int n) {
+    const double fills[] = { 0.05, 0.07, 0.5, 1.0 };
+    int bad = 0;
+    double saved_fill = bulk_fill;
+    Vehicle *vs = (Vehicle *)calloc((size_t)n, sizeof(Vehicle));
+    ParkingSpace *ss = (ParkingSpace *)calloc((size_t)n, sizeof(ParkingSpace));
+    int *order = (int *)malloc((size_t)n * sizeof(int));
+    if (!vs || !ss || !order) {
+        fprintf(stderr, "Err: Cannot allocate bulk load stress test.\n");
+        bad = 1;
+    } else {
+        printf("--- Bulk Load Stress: %d vehicles and spaces per fill ---\n", n);
+        for (int i = 0; i < n; i++) {
+            // The upper half shares a 12-character prefix, so those plates all get one inexact code
+            if (i < n / 2) snprintf(vs[i].v_num, sizeof(vs[i].v_num), "BK%08d", i);
+            else snprintf(vs[i].v_num, sizeof(vs[i].v_num), "BKLONGPREFIX%07d", i % 10000000);
+            strcpy(vs[i].owner, "Bench");
+            ss[i].id = i + 1;
+        }
+        for (size_t f = 0; f < sizeof(fills) / sizeof(fills[0]); f++) {
+            bulk_fill = fills[f];
+            cur_lot->v_root = bulkLoadVehicles(vs, n);
+            cur_lot->s_root = bulkLoadSpaces(ss, n);
+            int fill_bad = treeViolations();
+            for (int i = 0; i < n; i++) order[i] = i;
+            for (int i = n - 1; i > 0; i--) {
+                int j = (int)(benchRand() % (unsigned long long)(i + 1));
+                int t = order[i]; order[i] = order[j]; order[j] = t;
+            }
+            for (int k = 0; k < n; k++) {
+                if (!deleteVehicle(vs[order[k]].v_num)) fill_bad++;
+                if (!deleteSpace(ss[order[k]].id)) fill_bad++;
+                if ((k + 1) % (n / 8 + 1) == 0) fill_bad += treeViolations();
+            }
+            if (cur_lot->v_root || cur_lot->s_root) fill_bad++;
+            printf("Fill %.2f: %d deletes, %d violations\n", fills[f], 2 * n, fill_bad);
+            bad += fill_bad;
+            freeTree(&cur_lot->v_root, &cur_lot->v_pool);
+            freeVehicleStore();
+            freePlateIndex(&cur_lot->v_index);
+            freeTree(&cur_lot->s_root, &cur_lot->s_pool);
+        }
+        bulk_fill = saved_fill;
+        printf("Invariants: %s (%d violations)\n", bad ? "FAILED" : "ok", bad);
+    }
+    free(vs); free(ss); free(order);
+    return bad;
+}
+
+#define SERVER_MAX_EVENTS 64
+#define SERVER_LINE_MAX 256       // Longest request line
+#define SERVER_OUT_HIGH (1 << 20) // Stop reading a connection while this much output is queued
+#define CLIENT_PLATES 10000
+
+volatile sig_atomic_t server_stop = 0;
+
+void onServerSignal(int sig) {
+    (void)sig;
+    server_stop = 1;
+}
+
+// Opens a listening (or connected) stream socket for "unix:PATH", "HOST:PORT" or "PORT".
+// A bare port means 127.0.0.1. Returns the fd, or -1.
+int openSocket(const char *addr, bool listening) {
+    int fd = -1;
+    bool ok = true;
+    union { struct sockaddr sa; struct sockaddr_un un; struct sockaddr_in in; } sa;
+    socklen_t len;
+    memset(&sa, 0, sizeof(sa));
+
+    if (strncmp(addr, "unix:", 5) == 0) {
+        sa.un.sun_family = AF_UNIX;
+        ok = strlen(addr + 5) < sizeof(sa.un.sun_path);
+        if (ok) strcpy(sa.un.sun_path, addr + 5);
+        len = sizeof(sa.un);
+    } else {
+        char host[64] = "127.0.0.1";
+        const char *colon = strrchr(addr, ':');
+        const char *port = colon ? colon + 1 : addr;
+        if (colon) {
+            ok = colon - addr < (long)sizeof(host);
+            if (ok) { memcpy(host, addr, colon - addr); host[colon - addr] = '\0'; }
+        }
+        sa.in.sin_family = AF_INET;
+        sa.in.sin_port = htons((uint16_t)atoi(port));
+        ok = ok && atoi(port) > 0 && inet_pton(AF_INET, host, &sa.in.sin_addr) == 1;
+        len = sizeof(sa.in);
+    }
+    if (ok) {
+        fd = socket(sa.sa.sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        ok = fd >= 0;
+    }
+    if (ok && listening) {
+        int one = 1;
+        if (sa.sa.sa_family == AF_UNIX) unlink(sa.un.sun_path);
+        else setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        ok = bind(fd, &sa.sa, len) == 0 && listen(fd, SOMAXCONN) == 0;
+    } else if (ok) {
+        ok = connect(fd, &sa.sa, len) == 0;
+        if (ok && sa.sa.sa_family == AF_INET) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+    }
+    if (ok) ok = fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0;
+    if (!ok) {
+        fprintf(stderr, "Err: Cannot %s %s: %s.\n", listening ? "listen on" : "connect to", addr, strerror(errno));
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+typedef struct Conn {
+    int fd;
+    char in[SERVER_LINE_MAX * 16];
+    int in_len;
+    char *out;
+    size_t out_len, out_off, out_cap;
+    uint32_t events; // Currently registered epoll mask
+    bool eof;        // Peer closed its side; close once the replies are out
+    struct Conn *prev, *next;
+} Conn;
+
+bool connAppend(Conn *c, const char *data, size_t len) {
+    bool ok = true;
+    if (c->out_len + len > c->out_cap) {
+        size_t cap = c->out_cap ? c->out_cap : 4096;
+        while (cap < c->out_len + len) cap *= 2;
+        char *out = (char *)realloc(c->out, cap);
+        if (out) { c->out = out; c->out_cap = cap; }
+        else ok = false;
+    }
+    if (ok) {
+        memcpy(c->out + c->out_len, data, len);
+        c->out_len += len;
+    }
+    return ok;
+}
+
+// Returns the space a vehicle holds, or 0 if it is not parked.
+int parkedSpace(Lot *lot, const char *v_num) {
+    int s_id = 0;
+    useLot(lot);
+    pthread_rwlock_rdlock(&lot->state_lock);
+    pthread_mutex_t *m = plateLock(lot, v_num);
+    pthread_mutex_lock(m);
+    Vehicle *v = findVehicle(lot->v_root, v_num);
+    if (v && isParked(v)) s_id = v->space_id;
+    pthread_mutex_unlock(m);
+    pthread_rwlock_unlock(&lot->state_lock);
+    return s_id;
+}
+
+// Handles one request line and writes its one-line reply to buf. Requests:
+//   E PLATE OWNER   entry   -> OK space | NO
+//   X PLATE         exit    -> OK | NO
+//   L PLATE         lookup  -> V plate membership space parks hrs revenue | NF
+//   O               occupancy -> O free_gold free_premium free_general
+//   S SPACE         occupant  -> V plate membership space parks hrs revenue | NF
+int serveRequest(Lot *lot, const char *p, const char *eol, char *buf, size_t size) {
+    int n;
+    char op[2], v_num[20];
+    int op_len = readToken(&p, eol, op, 1);
+    bool has_plate = readToken(&p, eol, v_num, sizeof(v_num) - 1) > 0;
+    time_t now = time(NULL);
+
+    if (op_len == 1 && op[0] == 'E' && has_plate) {
+        char owner[50];
+        skipSpaces(&p, eol);
+        const char *end = eol;
+        while (end > p && isspace((unsigned char)end[-1])) end--;
+        if (end == p || end - p > (long)sizeof(owner) - 1) {
+            n = snprintf(buf, size, "ERR owner\n");
+        } else {
+            memcpy(owner, p, end - p); owner[end - p] = '\0';
+            if (vehicleEntry(lot, v_num, owner, now)) n = snprintf(buf, size, "OK %d\n", parkedSpace(lot, v_num));
+            else n = snprintf(buf, size, "NO\n");
+        }
+    } else if (op_len == 1 && op[0] == 'X' && has_plate) {
+        n = snprintf(buf, size, vehicleExit(lot, v_num, now) ? "OK\n" : "NO\n");
+    } else if (op_len == 1 && op[0] == 'L' && has_plate) {
+        useLot(lot);
+        pthread_rwlock_rdlock(&lot->state_lock);
+        pthread_mutex_t *m = plateLock(lot, v_num);
+        pthread_mutex_lock(m);
+        Vehicle *v = findVehicle(lot->v_root, v_num);
+        if (v) n = snprintf(buf, size, "V %s %d %d %d %.2f %.2f\n", v->v_num, v->membership,
+                            isParked(v) ? v->space_id : 0, v->parks, v->total_hrs, v->revenue);
+        else n = snprintf(buf, size, "NF\n");
+        pthread_mutex_unlock(m);
+        pthread_rwlock_unlock(&lot->state_lock);
+    } else if (op_len == 1 && op[0] == 'O') {
+        const SpaceTier *t = lot->s_alloc.tiers;
+        n = snprintf(buf, size, "O %d %d %d\n", __atomic_load_n(&t[0].nfree, __ATOMIC_RELAXED),
+                     __atomic_load_n(&t[1].nfree, __ATOMIC_RELAXED), __atomic_load_n(&t[2].nfree, __ATOMIC_RELAXED));
+    } else if (op_len == 1 && op[0] == 'S' && has_plate) {
+        n = 0;
+        useLot(lot);
+        pthread_rwlock_rdlock(&lot->state_lock);
+        int s_id = atoi(v_num);
+        VHandle h = s_id > 0 ? spaceOccupant(lot, s_id) : VH_NONE;
+        if (h != VH_NONE) {
+            // Plates do not change under the shared lock; the stripe guards the rest
+            Vehicle *v = vstoreGet(h);
+            pthread_mutex_t *m = plateLock(lot, v->v_num);
+            pthread_mutex_lock(m);
+            if (isParked(v) && v->space_id == s_id) {
+                n = snprintf(buf, size, "V %s %d %d %d %.2f %.2f\n", v->v_num, v->membership,
+                             v->space_id, v->parks, v->total_hrs, v->revenue);
+            }
+            pthread_mutex_unlock(m);
+        }
+        if (n == 0) n = snprintf(buf, size, "NF\n");
+        pthread_rwlock_unlock(&lot->state_lock);
+    } else {
+        n = snprintf(buf, size, "ERR request\n");
+    }
+    return n;
+}
+
+// Answers every complete line buffered on the connection, in order. Returns false if
+// the connection should be dropped.
+bool serveConn(Lot *lot, Conn *c, long *served) {
+    bool ok = true;
+    int start = 0;
+    char reply[SERVER_LINE_MAX];
+    while (ok && c->out_len - c->out_off < SERVER_OUT_HIGH) {
+        char *nl = memchr(c->in + start, '\n', c->in_len - start);
+        if (!nl) break;
+        const char *p = c->in + start, *eol = nl;
+        skipSpaces(&p, eol);
+        if (p < eol) {
+            ok = connAppend(c, reply, (size_t)serveRequest(lot, p, eol, reply, sizeof(reply)));
+            (*served)++;
+        }
+        start = (int)(nl - c->in) + 1;
+    }
+    memmove(c->in, c->in + start, c->in_len - start);
+    c->in_len -= start;
+    // A full buffer without a newline can never become a request
+    if (c->in_len == (int)sizeof(c->in)) ok = false;
+    return ok;
+}
+
+bool connFlush(Conn *c) {
+    bool ok = true;
+    while (ok && c->out_off < c->out_len) {
+        ssize_t w = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (w > 0) c->out_off += (size_t)w;
+        else if (w < 0 && errno == EINTR) continue;
+        else { ok = w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK); break; }
+    }
+    if (c->out_off == c->out_len) c->out_off = c->out_len = 0;
+    return ok;
+}
+
+// Re-registers the connection for reading while its output is small, and for
+// writing while output is pending.
+void connWatch(int ep, Conn *c) {
+    uint32_t want = 0;
+    if (!c->eof && c->out_len - c->out_off < SERVER_OUT_HIGH) want |= EPOLLIN;
+    if (c->out_off < c->out_len) want |= EPOLLOUT;
+    if (want != c->events) {
+        struct epoll_event ev = { .events = want, .data.ptr = c };
+        epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = want;
+    }
+}
+
+void connClose(int ep, Conn **conns, Conn *c) {
+    if (c->prev) c->prev->next = c->next;
+    else *conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->out);
+    free(c);
+}
+
+// Single-threaded epoll loop serving gate terminals for the lot until SIGINT/SIGTERM.
+// Clients may pipeline any number of requests; replies come back in request order.
+bool runServer(Lot *lot, const char *addr) {
+    bool success = true;
+    long served = 0;
+    Conn *conns = NULL;
+    int lfd = openSocket(addr, true);
+    int ep = lfd >= 0 ? epoll_create1(EPOLL_CLOEXEC) : -1;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+
+    if (ep < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev) != 0) {
+        success = false;
+    } else {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = onServerSignal;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+        gate_quiet = true;
+        printf("Serving lot %s on %s (Ctrl-C to stop).\n", lot->name, addr);
+        fflush(stdout);
+    }
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (success && !server_stop) {
+        int n = epoll_wait(ep, events, SERVER_MAX_EVENTS, -1);
+        for (int i = 0; i < n; i++) {
+            Conn *c = (Conn *)events[i].data.ptr;
+            if (!c) {
+                int fd;
+                while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    int one = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    c = (Conn *)calloc(1, sizeof(Conn));
+                    struct epoll_event cev = { .events = EPOLLIN, .data.ptr = c };
+                    if (!c || epoll_ctl(ep, EPOLL_CTL_ADD, fd, &cev) != 0) {
+                        close(fd);
+                        free(c);
+                    } else {
+                        c->fd = fd;
+                        c->events = EPOLLIN;
+                        c->next = conns;
+                        if (conns) conns->prev = c;
+                        conns = c;
+                    }
+                }
+                continue;
+            }
+            bool alive = true;
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !c->eof) {
+                ssize_t r = 1;
+                while (alive && c->out_len - c->out_off < SERVER_OUT_HIGH &&
+                       (r = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0)) > 0) {
+                    c->in_len += (int)r;
+                    alive = serveConn(lot, c, &served);
+                }
+                if (r == 0) c->eof = true;
+                else if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) alive = false;
+            }
+            if (alive) alive = connFlush(c);
+            // Output drained below the mark: answer requests that were left buffered
+            if (alive && c->in_len > 0 && c->out_len - c->out_off < SERVER_OUT_HIGH) {
+                alive = serveConn(lot, c, &served) && connFlush(c);
+            }
+            if (alive && c->eof && c->out_len == 0) alive = false;
+            if (alive) connWatch(ep, c);
+            else connClose(ep, &conns, c);
+        }
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            success = false;
+        }
+    }
+    while (conns) connClose(ep, &conns, conns);
+    gate_quiet = false;
+    if (success) printf("Server stopped after %ld requests.\n", served);
+    if (ep >= 0) close(ep);
+    if (lfd >= 0) {
+        close(lfd);
+        if (strncmp(addr, "unix:", 5) == 0) unlink(addr + 5);
+    }
+    return success;
+}
+
+typedef struct ClientConn {
+    int fd;
+    long quota, sent, done;
+    char in[SERVER_LINE_MAX * 16];
+    int in_len;
+    char out[SERVER_LINE_MAX * 64];
+    int out_len, out_off;
+    uint32_t armed; // Events currently registered with epoll
+} ClientConn;
+
+// Queues requests until depth are in flight: entries, exits, lookups and occupancy
+// polls over a fixed pool of plates.
+void clientFill(ClientConn *c, char (*plates)[20], int depth) {
+    while (c->sent < c->quota && c->sent - c->done < depth &&
+           c->out_len + SERVER_LINE_MAX <= (int)sizeof(c->out)) {
+        unsigned long long r = benchRand();
+        const char *plate = plates[r % CLIENT_PLATES];
+        int kind = (int)(r >> 40) % 100;
+        if (kind < 45) c->out_len += sprintf(c->out + c->out_len, "E %s Load Client\n", plate);
+        else if (kind < 80) c->out_len += sprintf(c->out + c->out_len, "X %s\n", plate);
+        else if (kind < 95) c->out_len += sprintf(c->out + c->out_len, "L %s\n", plate);
+        else c->out_len += sprintf(c->out + c->out_len, "O\n");
+        c->sent++;
+    }
+}
+
+// Load generator for the server: conns connections, each keeping depth requests in
+// flight, until requests replies have arrived. Prints throughput and reply counts.
+bool runLoadClient(const char *addr, int conns, int depth, long requests) {
+    bool success = true;
+    long ok = 0, no = 0, err = 0;
+    ClientConn *cs = (ClientConn *)calloc((size_t)conns, sizeof(ClientConn));
+    char (*plates)[20] = malloc(CLIENT_PLATES * sizeof(*plates));
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    int active = 0; // Connections still owed replies
+
+    if (!cs || !plates || ep < 0) {
+        fprintf(stderr, "Err: Cannot allocate load client.\n");
+        success = false;
+    } else {
+        for (int i = 0; i < CLIENT_PLATES; i++) benchPlate(plates[i]);
+        for (int i = 0; i < conns; i++) cs[i].fd = -1;
+        for (int i = 0; i < conns && success; i++) {
+            cs[i].quota = requests / conns + (i < requests % conns);
+            if (cs[i].quota == 0) continue; // More connections than requests
+            cs[i].fd = openSocket(addr, false);
+            cs[i].armed = EPOLLIN | EPOLLOUT; // Writable at once, which queues the first batch
+            struct epoll_event ev = { .events = cs[i].armed, .data.ptr = &cs[i] };
+            success = cs[i].fd >= 0 && epoll_ctl(ep, EPOLL_CTL_ADD, cs[i].fd, &ev) == 0;
+            if (success) active++;
+        }
+    }
+
+    double t0 = nowSeconds();
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (success && active > 0) {
+        int n = epoll_wait(ep, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR) { perror("epoll_wait"); success = false; }
+        for (int i = 0; i < n && success; i++) {
+            ClientConn *c = (ClientConn *)events[i].data.ptr;
+            ssize_t r;
+            while ((r = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0)) > 0) {
+                c->in_len += (int)r;
+                int start = 0;
+                char *nl;
+                while ((nl = memchr(c->in + start, '\n', c->in_len - start)) != NULL) {
+                    const char *line = c->in + start;
+                    if (line[0] == 'N') no++;
+                    else if (line[0] == 'E') err++;
+                    else ok++;
+                    c->done++;
+                    start = (int)(nl - c->in) + 1;
+                }
+                memmove(c->in, c->in + start, c->in_len - start);
+                c->in_len -= start;
+            }
+            if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                fprintf(stderr, "Err: Server closed the connection.\n");
+                success = false;
+            }
+            clientFill(c, plates, depth);
+            while (success && c->out_off < c->out_len) {
+                ssize_t w = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+                if (w > 0) c->out_off += (int)w;
+                else if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                else if (!(w < 0 && errno == EINTR)) success = false;
+            }
+            memmove(c->out, c->out + c->out_off, c->out_len - c->out_off);
+            c->out_len -= c->out_off;
+            c->out_off = 0;
+            if (c->done == c->quota) {
+                epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+                close(c->fd);
+                c->fd = -1;
+                active--;
+            } else if (success) {
+                // Level-triggered: EPOLLOUT stays armed only while output is pending, or the loop spins
+                uint32_t want = EPOLLIN | (c->out_len > 0 ? EPOLLOUT : 0);
+                if (want != c->armed) {
+                    struct epoll_event ev = { .events = want, .data.ptr = c };
+                    if (epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev) == 0) c->armed = want;
+                    else { perror("epoll_ctl"); success = false; }
+                }
+            }
+        }
+    }
+    double t1 = nowSeconds();
+
+    if (success) {
+        long total = ok + no + err;
+        printf("%ld requests over %d connections (depth %d) in %.3f s: %.0f req/s, %ld ok, %ld refused, %ld errors\n",
+               total, conns, depth, t1 - t0, t1 > t0 ? total / (t1 - t0) : 0.0, ok, no, err);
+    }
+    for (int i = 0; cs && i < conns; i++) {
+        if (cs[i].fd >= 0) close(cs[i].fd);
+    }
+    if (ep >= 0) close(ep);
+    free(cs); free(plates);
+    return success;
+}
+
+#define SUITE_MAX_PARKS 2000   // Cap on the visit count of the most frequent vehicles
+#define SUITE_VISITS_PER_VEHICLE 20
+#define SUITE_NEW_SHARE 10     // Percent of gate arrivals by plates not in the dataset
+#define SUITE_DISPLAY_REPS 50
+
+// Distinct plate for dataset id i; consecutive ids land in different regions so the
+// generated file is not in key order.
+void suitePlate(long i, char *buf) {
+    long r = i / 100;
+    sprintf(buf, "KA%02ld%c%c%04ld", i % 100, 'A' + (int)(r % 26), 'A' + (int)(r / 26 % 26), r / 676 % 10000);
+}
+
+// Cumulative Zipf(1) weights over n ranks; rank 0 is the most frequent vehicle.
+double *zipfTable(long n) {
+    double *cdf = (double *)malloc((size_t)n * sizeof(double));
+    double sum = 0.0;
+    for (long k = 0; cdf && k < n; k++) {
+        sum += 1.0 / (double)(k + 1);
+        cdf[k] = sum;
+    }
+    for (long k = 0; cdf && k < n; k++) cdf[k] /= sum;
+    return cdf;
+}
+
+long zipfSample(const double *cdf, long n) {
+    double u = (double)(benchRand() >> 11) / 9007199254740992.0;
+    long lo = 0, hi = n - 1;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (cdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Writes n vehicles and n_spaces free spaces in the input file formats. A vehicle's
+// visit count follows its Zipf weight, so tiers come out the way checkMembership
+// would assign them. Fills tiers[] with the membership mix.
+bool generateDataset(long n, int n_spaces, const double *cdf, long tiers[3]) {
+    bool ok = true;
+    static const char *first[] = { "Aarav", "Priya", "Rahul", "Sneha", "Vikram", "Ananya", "Arjun", "Kavya",
+                                   "Rohan", "Isha", "Karan", "Meera", "Nikhil", "Pooja", "Sanjay", "Divya" };
+    static const char *last[] = { "Sharma", "Iyer", "Reddy", "Nair", "Gupta", "Rao", "Patel", "Singh",
+                                  "Das", "Menon", "Joshi", "Kumar", "Shetty", "Bose", "Verma", "Pillai" };
+    char path[LOT_PATH_MAX];
+    FILE *fv = fopen(lotFile("complete-vehicle-database-100.txt", path), "w");
+    FILE *fs = fopen(lotFile("parking-lot-data.txt", path), "w");
+    EpochMin now_m = (EpochMin)(time(NULL) / 60);
+
+    if (!fv || !fs) {
+        fprintf(stderr, "Err: Cannot write dataset files in %s.\n", cur_lot->dir);
+        ok = false;
+    } else {
+        tiers[0] = tiers[1] = tiers[2] = 0;
+        for (long k = 0; k < n; k++) {
+            Vehicle v;
+            memset(&v, 0, sizeof(v));
+            double p = cdf[k] - (k ? cdf[k - 1] : 0.0);
+            double visits = p * (double)n * SUITE_VISITS_PER_VEHICLE;
+            v.parks = visits < 1.0 ? 1 : visits > SUITE_MAX_PARKS ? SUITE_MAX_PARKS : (int)visits;
+            suitePlate(k, v.v_num);
+            snprintf(v.owner, sizeof(v.owner), "%s %s", first[k % 16], last[k / 16 % 16]);
+            float stay = 1.0f + (float)(benchRand() % 300) / 60.0f;
+            v.total_hrs = stay * (float)v.parks;
+            checkMembership(&v);
+            v.revenue = calcPay(stay, v.membership) * (float)v.parks;
+            v.departed = now_m - (EpochMin)(benchRand() % (365 * 24 * 60));
+            v.arrived = v.departed - (EpochMin)(stay * 60.0f);
+            writeVehicleLine(fv, &v);
+            tiers[v.membership]++;
+        }
+        for (int i = 1; i <= n_spaces; i++) fprintf(fs, "%d 0 0.00 0.00\n", i);
+    }
+    if (fv && fclose(fv) != 0) ok = false;
+    if (fs && fclose(fs) != 0) ok = false;
+    return ok;
+}
+
+int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Prints one phase as a JSON object; lat (seconds per op, may be NULL) is sorted in place.
+// With secs 0 the phase time is the sum of its latencies.
+void printPhase(const char *name, long ops, double secs, double *lat, long n_lat, bool last) {
+    if (secs == 0.0) {
+        for (long i = 0; lat && i < n_lat; i++) secs += lat[i];
+    }
+    printf("    {\"name\": \"%s\", \"ops\": %ld, \"seconds\": %.6f, \"ops_per_s\": %.1f",
+           name, ops, secs, secs > 0 ? ops / secs : 0.0);
+    if (lat && n_lat > 0) {
+        sortRecords(lat, (size_t)n_lat, sizeof(double), compareDoubles);
+        printf(", \"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f, \"max_us\": %.3f",
+               lat[(long)(0.5 * (n_lat - 1))] * 1e6, lat[(long)(0.99 * (n_lat - 1))] * 1e6,
+               lat[(long)(0.999 * (n_lat - 1))] * 1e6, lat[n_lat - 1] * 1e6);
+    }
+    printf("}%s\n", last ? "" : ",");
+}
+
+// Generates a dataset of n vehicles in the bound lot's directory and times loading,
+// gate traffic, reports, saving and snapshot loading. Chatter from the engine is
+// discarded; the results go to stdout as one JSON object.
+bool runBenchSuite(long n) {
+    bool success = cur_lot->dir[0] != '\0';
+    int n_spaces = n / 10 > 100 ? (int)(n / 10) : 100;
+    long gate_ops = n, entries = 0, exits = 0, tiers[3];
+    double *cdf = success ? zipfTable(n) : NULL;
+    double *entry_lat = (double *)malloc((size_t)gate_ops * sizeof(double));
+    double *exit_lat = (double *)malloc((size_t)gate_ops * sizeof(double));
+    double *disp_lat = (double *)malloc(4 * SUITE_DISPLAY_REPS * sizeof(double));
+    long *parked = (long *)malloc((size_t)n_spaces * sizeof(long));
+    double t[8];
+    char path[LOT_PATH_MAX];
+
+    if (!cur_lot->dir[0]) {
+        fprintf(stderr, "Err: --bench-suite needs --lot=DIR; it overwrites that lot's data files.\n");
+    } else if (!cdf || !entry_lat || !exit_lat || !disp_lat || !parked) {
+        fprintf(stderr, "Err: Cannot allocate benchmark suite.\n");
+        success = false;
+    }
+
+    fflush(stdout);
+    int saved_out = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (success && (saved_out < 0 || null_fd < 0)) success = false;
+    if (success) {
+        dup2(null_fd, STDOUT_FILENO);
+        gate_quiet = true;
+
+        fprintf(stderr, "Generating %ld vehicles, %d spaces...\n", n, n_spaces);
+        t[0] = nowSeconds();
+        success = generateDataset(n, n_spaces, cdf, tiers);
+        t[1] = nowSeconds();
+    }
+    if (success) {
+        fprintf(stderr, "Loading...\n");
+        loadSpaces();
+        loadVehicles();
+        initAllocator();
+        t[2] = nowSeconds();
+
+        // Returning vehicles arrive by popularity, a share of arrivals are first-time
+        // plates, and a random parked vehicle leaves with probability equal to occupancy
+        fprintf(stderr, "Gate traffic: %ld events...\n", gate_ops);
+        time_t base = time(NULL);
+        char plate[20];
+        int n_parked = 0;
+        for (long i = 0; parked && i < gate_ops; i++) {
+            double s0;
+            if (n_parked > 0 && (long)(benchRand() % (unsigned long long)n_spaces) < n_parked) {
+                int j = (int)(benchRand() % (unsigned long long)n_parked);
+                suitePlate(parked[j], plate);
+                parked[j] = parked[--n_parked];
+                s0 = nowSeconds();
+                vehicleExit(cur_lot, plate, base + i);
+                exit_lat[exits++] = nowSeconds() - s0;
+            } else {
+                bool fresh = (long)(benchRand() % 100) < SUITE_NEW_SHARE;
+                long id = fresh ? n + (long)(benchRand() % (unsigned long long)n) : zipfSample(cdf, n);
+                suitePlate(id, plate);
+                s0 = nowSeconds();
+                bool ok = vehicleEntry(cur_lot, plate, "Suite Visitor", base + i);
+                entry_lat[entries++] = nowSeconds() - s0;
+                if (ok && n_parked < n_spaces) parked[n_parked++] = id;
+            }
+        }
+        t[3] = nowSeconds();
+
+        fprintf(stderr, "Reports...\n");
+        for (int r = 0; r < SUITE_DISPLAY_REPS; r++) {
+            double s0 = nowSeconds();
+            displayVByHrs(cur_lot->v_root, 10);
+            double s1 = nowSeconds();
+            displayVByRev(cur_lot->v_root, 10);
+            double s2 = nowSeconds();
+            displaySByHrs(cur_lot->s_root, 10);
+            double s3 = nowSeconds();
+            displaySByRev(cur_lot->s_root, 10);
+            double s4 = nowSeconds();
+            disp_lat[r] = s1 - s0;
+            disp_lat[SUITE_DISPLAY_REPS + r] = s2 - s1;
+            disp_lat[2 * SUITE_DISPLAY_REPS + r] = s3 - s2;
+            disp_lat[3 * SUITE_DISPLAY_REPS + r] = s4 - s3;
+        }
+        t[4] = nowSeconds();
+
+        fprintf(stderr, "Saving...\n");
+        saveVehiclesToFile(cur_lot->v_root, lotFile("bplus-vehicle-database.txt", path));
+        saveSpacesToFile(cur_lot->s_root, lotFile("bplus-parking-lot-data.txt", path));
+        success = saveSnapshot(lotFile(SNAPSHOT_FILE, path));
+        t[5] = nowSeconds();
+
+        fprintf(stderr, "Loading snapshot...\n");
+        freeTree(&cur_lot->v_root, &cur_lot->v_pool);
+        freeVehicleStore();
+        freePlateIndex(&cur_lot->v_index);
+        freeTree(&cur_lot->s_root, &cur_lot->s_pool);
+        freeRankings();
+        t[6] = nowSeconds();
+        success = success && loadSnapshot(path);
+        initAllocator();
+        t[7] = nowSeconds();
+
+        fflush(stdout);
+        dup2(saved_out, STDOUT_FILENO);
+        gate_quiet = false;
+    }
+    if (success) {
+        printf("{\n  \"vehicles\": %ld, \"spaces\": %d,\n", n, n_spaces);
+        printf("  \"tiers\": {\"general\": %ld, \"premium\": %ld, \"gold\": %ld},\n", tiers[0], tiers[1], tiers[2]);
+        printf("  \"phases\": [\n");
+        printPhase("generate", n, t[1] - t[0], NULL, 0, false);
+        printPhase("load_text", n, t[2] - t[1], NULL, 0, false);
+        printPhase("gates", gate_ops, t[3] - t[2], NULL, 0, false);
+        printPhase("vehicle_entry", entries, 0.0, entry_lat, entries, false);
+        printPhase("vehicle_exit", exits, 0.0, exit_lat, exits, false);
+        printPhase("display_v_by_hrs", SUITE_DISPLAY_REPS, 0.0, disp_lat, SUITE_DISPLAY_REPS, false);
+        printPhase("display_v_by_rev", SUITE_DISPLAY_REPS, 0.0, disp_lat + SUITE_DISPLAY_REPS, SUITE_DISPLAY_REPS, false);
+        printPhase("display_s_by_hrs", SUITE_DISPLAY_REPS, 0.0, disp_lat + 2 * SUITE_DISPLAY_REPS, SUITE_DISPLAY_REPS, false);
+        printPhase("display_s_by_rev", SUITE_DISPLAY_REPS, 0.0, disp_lat + 3 * SUITE_DISPLAY_REPS, SUITE_DISPLAY_REPS, false);
+        printPhase("save", n, t[5] - t[4], NULL, 0, false);
+        printPhase("load_snapshot", n, t[7] - t[6], NULL, 0, true);
+        printf("  ]\n}\n");
+    } else if (cur_lot->dir[0]) {
+        fprintf(stderr, "Err: Benchmark suite failed.\n");
+    }
+
+    freeTree(&cur_lot->v_root, &cur_lot->v_pool);
+    freeVehicleStore();
+    freePlateIndex(&cur_lot->v_index);
+    freeTree(&cur_lot->s_root, &cur_lot->s_pool);
+    freeAllocator();
+    freeRankings();
+    if (saved_out >= 0) close(saved_out);
+    if (null_fd >= 0) close(null_fd);
+    free(cdf); free(entry_lat); free(exit_lat); free(disp_lat); free(parked);
+    return success;
+}
+
+int main(int argc, char *argv[]) {
+    const char *mode = NULL; int bench_n = 1000000; int gates_n = 8; int bulk_n = 5000; long suite_n = 1000000;
+    bool args_ok = true; int rc = 0;
+    OpenOptions opt = { false, -1 };
+    const char *lot_dirs[MAX_LOTS]; int nlot_dirs = 0;
+    bool pin_lots = false;
+    ReplayOptions replay = { NULL, REPLAY_BATCH, false, false };
+    const char *replay_files[MAX_LOTS]; int nreplay = 0; // The i-th file goes to the i-th lot
+    const char *serve_addr = NULL, *client_addr = NULL;
+    const char *query_lo = NULL; char query_hi[20] = "";
+    int client_conns = 16, client_depth = 32; long client_requests = 200000;
+
+    for (int i = 1; i < argc && args_ok; i++) {
+        if (strcmp(argv[i], "--bench-tree") == 0) {
+            mode = argv[i];
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) bench_n = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-suite") == 0) {
+            mode = argv[i];
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) suite_n = atol(argv[++i]);
+            if (suite_n < 1) suite_n = 1;
+        } else if (strcmp(argv[i], "--stress-gates") == 0) {
+            mode = argv[i];
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) gates_n = atoi(argv[++i]);
+            if (gates_n < 1) gates_n = 1;
+        } else if (strcmp(argv[i], "--stress-bulk") == 0) {
+            mode = argv[i];
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) bulk_n = atoi(argv[++i]);
+            if (bulk_n < 1) bulk_n = 1;
+        } else if (strncmp(argv[i], "--fill=", 7) == 0) {
+            bulk_fill = atof(argv[i] + 7);
+            if (bulk_fill <= 0.0 || bulk_fill > 1.0) {
+                fprintf(stderr, "Err: --fill must be in (0, 1].\n");
+                args_ok = false;
+            }
+        } else if (strcmp(argv[i], "--import") == 0) {
+            opt.import_text = true;
+        } else if (strncmp(argv[i], "--journal-budget=", 17) == 0) {
+            journal_budget_ms = atoi(argv[i] + 17);
+            if (journal_budget_ms < 0) journal_budget_ms = 0;
+        } else if (strncmp(argv[i], "--checkpoint-every=", 19) == 0) {
+            checkpoint_every_s = atoi(argv[i] + 19);
+        } else if (strncmp(argv[i], "--archive-days=", 15) == 0) {
+            opt.archive_days = atoi(argv[i] + 15);
+        } else if (strcmp(argv[i], "--overflow=none") == 0) {
+            overflow_policy = OVERFLOW_NONE;
+        } else if (strcmp(argv[i], "--overflow=down") == 0) {
+            overflow_policy = OVERFLOW_DOWN;
+        } else if (strncmp(argv[i], "--lot=", 6) == 0 && argv[i][6] && nlot_dirs < MAX_LOTS) {
+            lot_dirs[nlot_dirs++] = argv[i] + 6;
+        } else if (strcmp(argv[i], "--pin-lots") == 0) {
+            pin_lots = true;
+        } else if (strncmp(argv[i], "--replay=", 9) == 0 && argv[i][9] && nreplay < MAX_LOTS) {
+            replay_files[nreplay++] = argv[i] + 9;
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            replay.batch = atoi(argv[i] + 8);
+            if (replay.batch < 1) replay.batch = 1;
+        } else if (strcmp(argv[i], "--sort-batch") == 0) {
+            replay.sort_batch = true;
+        } else if (strcmp(argv[i], "--replay-log") == 0) {
+            replay.log = true;
+        } else if (strncmp(argv[i], "--query-prefix=", 15) == 0 && argv[i][15]) {
+            query_lo = argv[i] + 15;
+            query_hi[0] = '\0';
+        } else if (strncmp(argv[i], "--query-range=", 14) == 0 && strchr(argv[i] + 14, ',')) {
+            const char *comma = strchr(argv[i] + 14, ',');
+            query_lo = argv[i] + 14;
+            snprintf(query_hi, sizeof(query_hi), "%s", comma + 1);
+            argv[i][comma - argv[i]] = '\0';
+        } else if (strncmp(argv[i], "--serve=", 8) == 0 && argv[i][8]) {
+            serve_addr = argv[i] + 8;
+        } else if (strncmp(argv[i], "--load-client=", 14) == 0 && argv[i][14]) {
+            mode = "--load-client";
+            client_addr = argv[i] + 14;
+        } else if (strncmp(argv[i], "--conns=", 8) == 0) {
+            client_conns = atoi(argv[i] + 8);
+            if (client_conns < 1) client_conns = 1;
+        } else if (strncmp(argv[i], "--depth=", 8) == 0) {
+            client_depth = atoi(argv[i] + 8);
+            if (client_depth < 1) client_depth = 1;
+        } else if (strncmp(argv[i], "--requests=", 11) == 0) {
+            client_requests = atol(argv[i] + 11);
+            if (client_requests < 1) client_requests = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--import] [--journal-budget=ms] [--checkpoint-every=s] [--archive-days=n] [--overflow=none|down] [--fill=0.9] [--lot=DIR ...] [--pin-lots] [--replay=FILE|- ... [--batch=n] [--sort-batch] [--replay-log]] [--query-prefix=P | --query-range=LO,HI] [--serve=ADDR] [--load-client=ADDR [--conns=n] [--depth=n] [--requests=n]] [--bench-tree [n]] [--bench-suite [n] --lot=DIR] [--stress-gates [n]] [--stress-bulk [n]]\n", argv[0]);
+            args_ok = false;
+        }
+    }
+
+    if (args_ok) {
+        if (nlot_dirs == 0) lot_dirs[nlot_dirs++] = "";
+        for (int i = 0; i < nlot_dirs && args_ok; i++) {
+            lots[nlots] = lotCreate(lot_dirs[i]);
+            if (lots[nlots]) nlots++;
+            else args_ok = false;
+        }
+        if (args_ok) useLot(lots[0]);
+        if (nreplay > nlots) {
+            fprintf(stderr, "Err: %d --replay files but only %d lots.\n", nreplay, nlots);
+            args_ok = false;
+        }
+    }
+
+    if (!args_ok) {
+        rc = 1;
+    } else if (mode && strcmp(mode, "--bench-tree") == 0) {
+        runTreeBenchmark(bench_n);
+    } else if (mode && strcmp(mode, "--bench-suite") == 0) {
+        rc = runBenchSuite(suite_n) ? 0 : 1;
+    } else if (mode && strcmp(mode, "--stress-gates") == 0) {
+        rc = runGateStress(gates_n) ? 1 : 0;
+    } else if (mode && strcmp(mode, "--stress-bulk") == 0) {
+        rc = runBulkStress(bulk_n) ? 1 : 0;
+    } else if (mode && strcmp(mode, "--load-client") == 0) {
+        rc = runLoadClient(client_addr, client_conns, client_depth, client_requests) ? 0 : 1;
+    } else {
+        if (pin_lots) {
+            long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+            if (ncpu < 1) ncpu = 1;
+            for (int i = 0; i < nlots; i++) startLotWorker(lots[i], (int)(i % ncpu));
+        }
+        // Replay output goes out in large blocks instead of line by line
+        if (nreplay > 0) setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+        printf("--- Init Parking System ---\n");
+        for (int i = 0; i < nlots; i++) lotSubmit(lots[i], openLot, &opt);
+        for (int i = 0; i < nlots; i++) lotWait(lots[i]);
+        printf("--- Init Complete ---\n");
+
+        if (nreplay > 0) {
+            // Each lot replays its own file on its worker, so pinned lots run in parallel
+            ReplayJob jobs[MAX_LOTS];
+            double t0 = nowSeconds();
+            for (int i = 0; i < nreplay; i++) {
+                jobs[i].opt = replay;
+                jobs[i].opt.fname = replay_files[i];
+                lotSubmit(lots[i], replayLot, &jobs[i]);
+            }
+            for (int i = 0; i < nreplay; i++) {
+                lotWait(lots[i]);
+                if (!jobs[i].ok) rc = 1;
+            }
+            if (nreplay > 1) printf("Replayed %d lots in %.3f s.\n", nreplay, nowSeconds() - t0);
+            closeAllLots(true);
+        } else if (query_lo) {
+            displayVehicleScan(query_lo, query_hi[0] ? query_hi : NULL);
+            closeAllLots(false); // Read-only: nothing to save
+        } else if (serve_addr) {
+            if (!runServer(lots[0], serve_addr)) rc = 1;
+            closeAllLots(true);
+        } else {
+            showMenu();
+        }
+
+        printf("Program end.\n");
+    }
+    for (int i = 0; i < nlots; i++) lotFree(lots[i]);
+    return rc;
 }